@@ -144,13 +144,17 @@ SOURCES += src/main.cpp \
     src/tor/ProtocolInfoCommand.cpp \
     src/tor/AuthenticateCommand.cpp \
     src/tor/SetConfCommand.cpp \
+    src/tor/AddOnionCommand.cpp \
     src/utils/StringUtil.cpp \
     src/core/ContactsManager.cpp \
     src/core/ContactUser.cpp \
     src/tor/GetConfCommand.cpp \
     src/tor/HiddenService.cpp \
     src/utils/CryptoKey.cpp \
+    src/utils/CryptoExecutor.cpp \
+    src/utils/OnionAddress.cpp \
     src/utils/SecureRNG.cpp \
+    src/utils/UnixSocket.cpp \
     src/core/OutgoingContactRequest.cpp \
     src/core/IncomingRequestManager.cpp \
     src/core/ContactIDValidator.cpp \
@@ -160,8 +164,13 @@ SOURCES += src/main.cpp \
     src/tor/TorProcess.cpp \
     src/tor/TorManager.cpp \
     src/tor/TorSocket.cpp \
+    src/tor/TorEvents.cpp \
+    src/tor/TorLog.cpp \
+    src/tor/ConnectionTimings.cpp \
+    src/tor/DescriptorProbe.cpp \
     src/ui/LinkedText.cpp \
     src/utils/Settings.cpp \
+    src/utils/LegacySettings.cpp \
     src/utils/PendingOperation.cpp \
     src/ui/LanguagesModel.cpp
 
@@ -173,13 +182,17 @@ HEADERS += src/ui/MainWindow.h \
     src/tor/ProtocolInfoCommand.h \
     src/tor/AuthenticateCommand.h \
     src/tor/SetConfCommand.h \
+    src/tor/AddOnionCommand.h \
     src/utils/StringUtil.h \
     src/core/ContactsManager.h \
     src/core/ContactUser.h \
     src/tor/GetConfCommand.h \
     src/tor/HiddenService.h \
     src/utils/CryptoKey.h \
+    src/utils/CryptoExecutor.h \
+    src/utils/OnionAddress.h \
     src/utils/SecureRNG.h \
+    src/utils/UnixSocket.h \
     src/core/OutgoingContactRequest.h \
     src/core/IncomingRequestManager.h \
     src/core/ContactIDValidator.h \
@@ -190,8 +203,13 @@ HEADERS += src/ui/MainWindow.h \
     src/tor/TorProcess_p.h \
     src/tor/TorManager.h \
     src/tor/TorSocket.h \
+    src/tor/TorEvents.h \
+    src/tor/TorLog.h \
+    src/tor/ConnectionTimings.h \
+    src/tor/DescriptorProbe.h \
     src/ui/LinkedText.h \
     src/utils/Settings.h \
+    src/utils/LegacySettings.h \
     src/utils/PendingOperation.h \
     src/ui/LanguagesModel.h
 
@@ -45,6 +45,13 @@
 #include <QTcpSocket>
 #include <QtEndian>
 
+static constexpr SettingsKey<QString> nicknameKey("nickname");
+static constexpr SettingsKey<QString> hostnameKey("hostname");
+static constexpr SettingsKey<int> portKey("port");
+static constexpr SettingsKey<bool> rejectedKey("rejected");
+static constexpr SettingsKey<bool> upgradeNotificationKey("sentUpgradeNotification");
+static constexpr SettingsKey<QDateTime> lastConnectedKey("lastConnected");
+
 ContactUser::ContactUser(UserIdentity *ident, int id, QObject *parent)
     : QObject(parent)
     , identity(ident)
@@ -55,12 +62,16 @@ ContactUser::ContactUser(UserIdentity *ident, int id, QObject *parent)
     , m_lastReceivedChatID(0)
     , m_contactRequest(0)
     , m_settings(0)
+    , m_state(0)
     , m_conversation(0)
 {
     Q_ASSERT(uniqueID >= 0);
 
-    m_settings = new SettingsObject(QStringLiteral("contacts.%1").arg(uniqueID));
+    m_settings = new SettingsObject(identity->settingsPath(QStringLiteral("contacts.%1").arg(uniqueID)));
     connect(m_settings, &SettingsObject::modified, this, &ContactUser::onSettingsModified);
+    m_state = new SettingsObject(SettingsObject::stateFile(), m_settings->path());
+    migrateState();
+    m_onionAddress = OnionAddress::fromString(hostname());
 
     m_conversation = new ConversationModel(this);
     m_conversation->setContact(this);
@@ -73,6 +84,25 @@ ContactUser::ContactUser(UserIdentity *ident, int id, QObject *parent)
 ContactUser::~ContactUser()
 {
     delete m_settings;
+    delete m_state;
+}
+
+/* Runtime state was stored with the configuration in older versions; move
+ * it to the state file if that is separate. */
+void ContactUser::migrateState()
+{
+    if (m_state->file() == m_settings->file())
+        return;
+
+    static const char *keys[] = { "lastConnected", "rejected", "sentUpgradeNotification" };
+    for (unsigned i = 0; i < sizeof(keys) / sizeof(*keys); i++) {
+        QJsonValue value = m_settings->read(keys[i]);
+        if (value.isUndefined())
+            continue;
+        if (m_state->read(keys[i]).isUndefined())
+            m_state->write(keys[i], value);
+        m_settings->write(keys[i], QJsonValue::Undefined);
+    }
 }
 
 void ContactUser::loadContactRequest()
@@ -110,9 +140,9 @@ void ContactUser::updateStatus()
         }
     } else if (m_connection && m_connection->isConnected()) {
         newStatus = Online;
-    } else if (settings()->read("rejected").toBool()) {
+    } else if (m_state->read(rejectedKey)) {
         newStatus = RequestRejected;
-    } else if (settings()->read("sentUpgradeNotification").toBool()) {
+    } else if (m_state->read(upgradeNotificationKey)) {
         newStatus = Outdated;
     } else {
         newStatus = Offline;
@@ -129,9 +159,10 @@ void ContactUser::updateStatus()
 
 void ContactUser::onSettingsModified(const QString &key, const QJsonValue &value)
 {
-    Q_UNUSED(value);
     if (key == QLatin1String("nickname"))
         emit nicknameChanged();
+    else if (key == QLatin1String("hostname"))
+        m_onionAddress = OnionAddress::fromString(value.toString());
 }
 
 void ContactUser::updateOutgoingSocket()
@@ -147,7 +178,7 @@ void ContactUser::updateOutgoingSocket()
     }
 
     // Refuse to make outgoing connections to the local hostname
-    if (hostname() == identity->hostname())
+    if (m_onionAddress == OnionAddress::fromString(identity->hostname()))
         return;
 
     if (m_outgoingSocket && m_outgoingSocket->status() == Protocol::OutboundConnector::Ready) {
@@ -179,7 +210,7 @@ void ContactUser::updateOutgoingSocket()
          */
         connect(m_outgoingSocket, &Protocol::OutboundConnector::oldVersionNegotiated, this,
             [this](QTcpSocket *socket) {
-                if (m_settings->read("sentUpgradeNotification").toBool())
+                if (m_state->read(upgradeNotificationKey))
                     return;
                 QByteArray secret = m_settings->read<Base64Encode>("remoteSecret");
                 if (secret.size() != 16)
@@ -205,7 +236,7 @@ void ContactUser::updateOutgoingSocket()
                 data.append(upgradeMessage);
                 socket->write(data);
 
-                m_settings->write("sentUpgradeNotification", true);
+                m_state->write(upgradeNotificationKey, true);
                 updateStatus();
             }
         );
@@ -223,24 +254,24 @@ void ContactUser::onConnected()
         return;
     }
 
-    m_settings->write("lastConnected", QDateTime::currentDateTime());
+    m_state->write(lastConnectedKey, QDateTime::currentDateTime());
 
     if (m_contactRequest && m_connection->purpose() == Protocol::Connection::Purpose::OutboundRequest) {
         qDebug() << "Sending contact request for" << uniqueID << nickname();
         m_contactRequest->sendRequest(m_connection);
     }
 
-    if (!m_settings->read("sentUpgradeNotification").isNull())
-        m_settings->unset("sentUpgradeNotification");
+    if (!m_state->read("sentUpgradeNotification").isNull())
+        m_state->unset("sentUpgradeNotification");
 
     /* The 'rejected' mark comes from failed authentication to someone who we thought was a known
      * contact. Normally, it would mean that you were removed from that person's contacts. It's
      * possible for this to be undone; for example, if that person sends you a new contact request,
      * it will be automatically accepted. If this happens, unset the 'rejected' flag for correct UI.
      */
-    if (m_settings->read("rejected").toBool()) {
+    if (m_state->read(rejectedKey)) {
         qDebug() << "Contact had marked us as rejected, but now they've connected again. Re-enabling.";
-        m_settings->unset("rejected");
+        m_state->unset(rejectedKey);
     }
 
     updateStatus();
@@ -258,7 +289,7 @@ void ContactUser::onConnected()
 void ContactUser::onDisconnected()
 {
     qDebug() << "Contact" << uniqueID << "disconnected";
-    m_settings->write("lastConnected", QDateTime::currentDateTime());
+    m_state->write(lastConnectedKey, QDateTime::currentDateTime());
 
     if (m_connection) {
         if (m_connection->isConnected()) {
@@ -281,24 +312,34 @@ SettingsObject *ContactUser::settings()
     return m_settings;
 }
 
+SettingsObject *ContactUser::state()
+{
+    return m_state;
+}
+
+QDateTime ContactUser::lastConnected() const
+{
+    return m_state->read(lastConnectedKey);
+}
+
 QString ContactUser::nickname() const
 {
-    return m_settings->read("nickname").toString();
+    return m_settings->read(nicknameKey);
 }
 
 void ContactUser::setNickname(const QString &nickname)
 {
-    m_settings->write("nickname", nickname);
+    m_settings->write(nicknameKey, nickname);
 }
 
 QString ContactUser::hostname() const
 {
-    return m_settings->read("hostname").toString();
+    return m_settings->read(hostnameKey);
 }
 
 quint16 ContactUser::port() const
 {
-    return m_settings->read("port", 9878).toInt();
+    return m_settings->read(portKey, 9878);
 }
 
 QString ContactUser::contactID() const
@@ -308,12 +349,14 @@ QString ContactUser::contactID() const
 
 void ContactUser::setHostname(const QString &hostname)
 {
-    QString fh = hostname;
-
-    if (!hostname.endsWith(QLatin1String(".onion")))
-        fh.append(QLatin1String(".onion"));
+    OnionAddress address = OnionAddress::fromString(hostname);
+    if (!address.isValid()) {
+        BUG() << "Invalid hostname for contact:" << hostname;
+        return;
+    }
 
-    m_settings->write("hostname", fh);
+    m_onionAddress = address;
+    m_settings->write(hostnameKey, address.hostname());
     updateOutgoingSocket();
 }
 
@@ -333,6 +376,7 @@ void ContactUser::deleteContact()
     emit contactDeleted(this);
 
     m_settings->undefine();
+    m_state->undefine();
     deleteLater();
 }
 
@@ -381,7 +425,7 @@ void ContactUser::assignConnection(const QSharedPointer<Protocol::Connection> &c
         return;
     }
 
-    if (!connection->hasAuthenticatedAs(Protocol::Connection::HiddenServiceAuth, hostname())) {
+    if (!connection->hasAuthenticatedAs(Protocol::Connection::HiddenServiceAuth, m_onionAddress)) {
         BUG() << "Connection assigned to contact without matching authentication";
         connection->close();
         return;
@@ -403,7 +447,7 @@ void ContactUser::assignConnection(const QSharedPointer<Protocol::Connection> &c
                 BUG() << "Outgoing contact request not unset after implicit accept during connection";
         } else if (!m_contactRequest && !knownToPeer) {
             qDebug() << "Contact says we're unknown; marking as rejected";
-            settings()->write("rejected", true);
+            m_state->write(rejectedKey, true);
             connection->close();
             updateStatus();
             updateOutgoingSocket();
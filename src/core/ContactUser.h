@@ -40,6 +40,7 @@
 #include <QSharedPointer>
 #include "utils/Settings.h"
 #include "protocol/Connection.h"
+#include "utils/OnionAddress.h"
 
 class UserIdentity;
 class OutgoingContactRequest;
@@ -68,6 +69,7 @@ class ContactUser : public QObject
     Q_PROPERTY(Status status READ status NOTIFY statusChanged)
     Q_PROPERTY(OutgoingContactRequest *contactRequest READ contactRequest NOTIFY statusChanged)
     Q_PROPERTY(SettingsObject *settings READ settings CONSTANT)
+    Q_PROPERTY(SettingsObject *state READ state CONSTANT)
     Q_PROPERTY(ConversationModel *conversation READ conversation CONSTANT)
 
     friend class ContactsManager;
@@ -101,6 +103,8 @@ public:
     QString nickname() const;
     /* Hostname is in the onion hostname format, i.e. it ends with .onion */
     QString hostname() const;
+    /* Parsed form of hostname(), for comparisons */
+    OnionAddress onionAddress() const { return m_onionAddress; }
     quint16 port() const;
     /* Contact ID in the ricochet: format */
     QString contactID() const;
@@ -108,6 +112,10 @@ public:
     Status status() const { return m_status; }
 
     SettingsObject *settings();
+    /* Volatile runtime state, such as lastConnected, stored outside of the configuration */
+    SettingsObject *state();
+    /* When a connection to this contact was last made, or invalid if never */
+    QDateTime lastConnected() const;
 
     Q_INVOKABLE void deleteContact();
 
@@ -157,12 +165,15 @@ private:
     quint16 m_lastReceivedChatID;
     OutgoingContactRequest *m_contactRequest;
     SettingsObject *m_settings;
+    SettingsObject *m_state;
     ConversationModel *m_conversation;
+    OnionAddress m_onionAddress;
 
     /* See ContactsManager::addContact */
     static ContactUser *addNewContact(UserIdentity *identity, int id);
 
     void loadContactRequest();
+    void migrateState();
     void updateOutgoingSocket();
 
     void clearConnection();
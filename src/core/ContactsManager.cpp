@@ -31,12 +31,18 @@
  */
 
 #include "ContactsManager.h"
+#include "UserIdentity.h"
 #include "IncomingRequestManager.h"
 #include "OutgoingContactRequest.h"
 #include "ContactIDValidator.h"
 #include "ConversationModel.h"
+#include "tor/TorManager.h"
+#include "tor/TorControl.h"
+#include "tor/DescriptorProbe.h"
+#include "protocol/OutboundConnector.h"
 #include <QStringList>
 #include <QDebug>
+#include <algorithm>
 
 #ifdef Q_OS_MAC
 #include <QtMac>
@@ -45,14 +51,31 @@
 ContactsManager *contactsManager = 0;
 
 ContactsManager::ContactsManager(UserIdentity *id)
-    : identity(id), incomingRequests(this), highestID(-1)
+    : identity(id), incomingRequests(this), highestID(-1), loggedFirstContactOnline(false)
 {
-    contactsManager = this;
+    // The first identity's contacts, for code that predates multiple identities
+    if (!contactsManager)
+        contactsManager = this;
+
+    /* Offline contacts are probed for a published descriptor when Tor has
+     * connectivity and periodically after that. A contact that has one is
+     * dialed right away instead of waiting for its reconnect interval, and
+     * Tor keeps the fetched descriptor for that connection. A contact that
+     * doesn't isn't dialed again until the next probe. */
+    if (torControl) {
+        connect(torControl, &Tor::TorControl::connectivityChanged, this, &ContactsManager::probeOfflineContacts);
+        connect(torControl->descriptorProbe(), &Tor::DescriptorProbe::probeFinished, this,
+                &ContactsManager::descriptorProbeFinished);
+    }
+
+    SettingsObject settings(QStringLiteral("tor"));
+    probeTimer.setInterval(settings.read("descriptorProbeInterval", 300).toInt() * 1000);
+    connect(&probeTimer, &QTimer::timeout, this, &ContactsManager::probeOfflineContacts);
 }
 
 void ContactsManager::loadFromSettings()
 {
-    SettingsObject settings(QStringLiteral("contacts"));
+    SettingsObject settings(identity->settingsPath(QStringLiteral("contacts")));
     foreach (const QString &key, settings.data().keys())
     {
         bool ok = false;
@@ -96,6 +119,83 @@ void ContactsManager::connectSignals(ContactUser *user)
     connect(user, SIGNAL(contactDeleted(ContactUser*)), SLOT(contactDeleted(ContactUser*)));
     connect(user->conversation(), &ConversationModel::unreadCountChanged, this, &ContactsManager::onUnreadCountChanged);
     connect(user, &ContactUser::statusChanged, [this,user]() { emit contactStatusChanged(user, user->status()); });
+    connect(user, &ContactUser::statusChanged, this, &ContactsManager::logFirstContactOnline);
+}
+
+void ContactsManager::logFirstContactOnline()
+{
+    ContactUser *user = qobject_cast<ContactUser*>(sender());
+    if (loggedFirstContactOnline || !user || user->status() != ContactUser::Online)
+        return;
+
+    loggedFirstContactOnline = true;
+    qint64 elapsed = Tor::TorManager::instance()->elapsedSinceStart();
+    if (elapsed >= 0)
+        qDebug() << "First contact online" << elapsed << "ms after starting Tor";
+}
+
+void ContactsManager::probeOfflineContacts()
+{
+    if (!torControl || !torControl->hasConnectivity()) {
+        probeTimer.stop();
+        return;
+    }
+
+    Tor::DescriptorProbe *probe = torControl->descriptorProbe();
+    if (!probe->isSupported())
+        return;
+
+    if (!probeTimer.isActive() && probeTimer.interval() > 0)
+        probeTimer.start();
+
+    /* Probe the contacts most likely to be online first: those found
+     * published last time, then by most recent connection, and those found
+     * unpublished last. */
+    QList<ContactUser*> offline;
+    foreach (ContactUser *user, pContacts) {
+        if (user->status() == ContactUser::Offline || user->status() == ContactUser::RequestPending)
+            offline.append(user);
+    }
+
+    auto rank = [probe](ContactUser *user) -> int {
+        switch (probe->lastResult(user->onionAddress())) {
+            case Tor::DescriptorProbe::Published: return 0;
+            case Tor::DescriptorProbe::NotPublished: return 2;
+            default: return 1;
+        }
+    };
+    QHash<ContactUser*,QDateTime> lastConnected;
+    foreach (ContactUser *user, offline)
+        lastConnected.insert(user, user->lastConnected());
+    std::stable_sort(offline.begin(), offline.end(),
+        [&rank,&lastConnected](ContactUser *a, ContactUser *b) {
+            int ra = rank(a), rb = rank(b);
+            if (ra != rb)
+                return ra < rb;
+            return lastConnected.value(a) > lastConnected.value(b);
+        }
+    );
+
+    foreach (ContactUser *user, offline) {
+        // Don't dial contacts that weren't published until a probe finds they are
+        if (rank(user) == 2 && user->m_outgoingSocket && probeTimer.interval() > 0)
+            user->m_outgoingSocket->retryLater(probeTimer.interval() / 1000);
+        probe->probe(user->onionAddress());
+    }
+}
+
+void ContactsManager::descriptorProbeFinished(const OnionAddress &address, int result)
+{
+    ContactUser *user = lookupAddress(address);
+    if (!user || !user->m_outgoingSocket)
+        return;
+
+    if (result == Tor::DescriptorProbe::Published) {
+        user->m_outgoingSocket->retryNow();
+    } else if (result == Tor::DescriptorProbe::NotPublished && probeTimer.interval() > 0) {
+        // Attempts would fail until the contact publishes; the next probe finds that
+        user->m_outgoingSocket->retryLater(probeTimer.interval() / 1000);
+    }
 }
 
 ContactUser *ContactsManager::createContactRequest(const QString &contactid, const QString &nickname,
@@ -142,16 +242,17 @@ ContactUser *ContactsManager::lookupSecret(const QByteArray &secret) const
 
 ContactUser *ContactsManager::lookupHostname(const QString &hostname) const
 {
-    QString ohost = ContactIDValidator::hostnameFromID(hostname);
-    if (ohost.isNull())
-        ohost = hostname;
+    return lookupAddress(OnionAddress::fromString(hostname));
+}
 
-    if (!ohost.endsWith(QLatin1String(".onion")))
-        ohost.append(QLatin1String(".onion"));
+ContactUser *ContactsManager::lookupAddress(const OnionAddress &address) const
+{
+    if (!address.isValid())
+        return 0;
 
     for (QList<ContactUser*>::ConstIterator it = pContacts.begin(); it != pContacts.end(); ++it)
     {
-        if (ohost.compare((*it)->hostname(), Qt::CaseInsensitive) == 0)
+        if ((*it)->onionAddress() == address)
             return *it;
     }
 
@@ -35,6 +35,7 @@
 
 #include <QObject>
 #include <QList>
+#include <QTimer>
 #include "ContactUser.h"
 #include "IncomingRequestManager.h"
 
@@ -63,6 +64,7 @@ public:
     const QList<ContactUser*> &contacts() const { return pContacts; }
     ContactUser *lookupSecret(const QByteArray &secret) const;
     ContactUser *lookupHostname(const QString &hostname) const;
+    ContactUser *lookupAddress(const OnionAddress &address) const;
     ContactUser *lookupNickname(const QString &nickname) const;
     ContactUser *lookupUniqueID(int uniqueID) const;
 
@@ -91,10 +93,15 @@ signals:
 private slots:
     void contactDeleted(ContactUser *user);
     void onUnreadCountChanged();
+    void logFirstContactOnline();
+    void probeOfflineContacts();
+    void descriptorProbeFinished(const OnionAddress &address, int result);
 
 private:
     QList<ContactUser*> pContacts;
     int highestID;
+    QTimer probeTimer;
+    bool loggedFirstContactOnline;
 
     void connectSignals(ContactUser *user);
 };
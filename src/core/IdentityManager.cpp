@@ -31,8 +31,10 @@
  */
 
 #include "IdentityManager.h"
-#include "ContactIDValidator.h"
 #include "core/OutgoingContactRequest.h"
+#include "utils/OnionAddress.h"
+#include <QElapsedTimer>
+#include <algorithm>
 #include <QDebug>
 
 IdentityManager *identityManager = 0;
@@ -69,15 +71,44 @@ void IdentityManager::addIdentity(UserIdentity *identity)
 void IdentityManager::loadFromSettings()
 {
     SettingsObject settings;
-    if (settings.read("identity") != QJsonValue::Undefined)
-    {
-        addIdentity(new UserIdentity(0, this));
-    }
-    else
+    if (settings.read("identity") == QJsonValue::Undefined)
     {
         /* No identities exist (probably inital run); create one */
         createIdentity();
+        return;
+    }
+
+    /* Identities after the first are kept under "identities", by ID. Load
+     * times are logged to keep an eye on the cost of each identity. */
+    QList<int> ids;
+    ids.append(0);
+    foreach (const QString &key, settings.read<QJsonObject>("identities").keys())
+    {
+        bool ok = false;
+        int id = key.toInt(&ok);
+        if (!ok || id <= 0)
+        {
+            qWarning() << "Ignoring identity" << key << "with an invalid ID";
+            continue;
+        }
+        ids.append(id);
     }
+    std::sort(ids.begin(), ids.end());
+
+    QElapsedTimer total;
+    total.start();
+    foreach (int id, ids)
+    {
+        QElapsedTimer timer;
+        timer.start();
+        UserIdentity *identity = new UserIdentity(id, this);
+        addIdentity(identity);
+        qDebug() << "Loaded identity" << id << "with" << identity->contacts.contacts().size()
+                 << "contacts in" << timer.elapsed() << "ms";
+    }
+
+    if (ids.size() > 1)
+        qDebug() << "Loaded" << ids.size() << "identities in" << total.elapsed() << "ms";
 }
 
 UserIdentity *IdentityManager::createIdentity(const QString &serviceDirectory, const QString &nickname)
@@ -96,16 +127,13 @@ UserIdentity *IdentityManager::createIdentity(const QString &serviceDirectory, c
 
 UserIdentity *IdentityManager::lookupHostname(const QString &hostname) const
 {
-    QString ohost = ContactIDValidator::hostnameFromID(hostname);
-    if (ohost.isNull())
-        ohost = hostname;
-
-    if (!ohost.endsWith(QLatin1String(".onion")))
-        ohost.append(QLatin1String(".onion"));
+    OnionAddress address = OnionAddress::fromString(hostname);
+    if (!address.isValid())
+        return 0;
 
     for (QList<UserIdentity*>::ConstIterator it = m_identities.begin(); it != m_identities.end(); ++it)
     {
-        if (ohost.compare((*it)->hostname(), Qt::CaseInsensitive) == 0)
+        if (OnionAddress::fromString((*it)->hostname()) == address)
             return *it;
     }
 
@@ -61,7 +61,10 @@ IncomingRequestManager::IncomingRequestManager(ContactsManager *c)
 
 void IncomingRequestManager::loadRequests()
 {
-    SettingsObject settings(QStringLiteral("contactRequests"));
+    loadRejectedHosts();
+    connect(contacts->identity->settings(), &SettingsObject::modified, this, &IncomingRequestManager::onSettingsModified);
+
+    SettingsObject settings(contacts->identity->settingsPath(QStringLiteral("contactRequests")));
 
     foreach (const QString &hostStr, settings.data().keys()) {
         QByteArray host = hostStr.toLatin1();
@@ -70,9 +73,53 @@ void IncomingRequestManager::loadRequests()
 
         IncomingContactRequest *request = new IncomingContactRequest(this, host);
         request->load();
+        addRequest(request);
+    }
+}
+
+void IncomingRequestManager::loadRejectedHosts()
+{
+    SettingsObject *settings = contacts->identity->settings();
+
+    // Older versions stored the blacklist as an array, which had to be copied for each append
+    QJsonValue legacyBlacklist = settings->read("hostnameBlacklist");
+    if (legacyBlacklist.isArray()) {
+        // The original rejection times weren't kept; use the time of migration
+        QDateTime now = QDateTime::currentDateTime();
+        SettingsTransaction transaction(settings);
+        foreach (const QJsonValue &value, legacyBlacklist.toArray()) {
+            OnionAddress address = OnionAddress::fromString(value.toString());
+            if (address.isValid())
+                settings->write(QStringLiteral("rejectedHostnames.") + address.serviceID(), now);
+        }
+        settings->unset("hostnameBlacklist");
+    }
+
+    m_rejectedHosts.clear();
+    QJsonObject rejected = settings->read<QJsonObject>("rejectedHostnames");
+    for (QJsonObject::const_iterator it = rejected.constBegin(); it != rejected.constEnd(); it++) {
+        OnionAddress address = OnionAddress::fromString(it.key());
+        if (address.isValid() && it.value().isString())
+            m_rejectedHosts.insert(address);
+    }
+}
+
+void IncomingRequestManager::onSettingsModified(const QString &key, const QJsonValue &value)
+{
+    static const QString prefix = QStringLiteral("rejectedHostnames");
+    if (!key.startsWith(prefix))
+        return;
 
-        m_requests.append(request);
-        emit requestAdded(request);
+    if (key.size() == prefix.size()) {
+        loadRejectedHosts();
+    } else if (key.at(prefix.size()) == QLatin1Char('.')) {
+        OnionAddress address = OnionAddress::fromString(key.mid(prefix.size() + 1));
+        if (!address.isValid())
+            return;
+        if (value.isString())
+            m_rejectedHosts.insert(address);
+        else
+            m_rejectedHosts.remove(address);
     }
 }
 
@@ -91,11 +138,12 @@ IncomingContactRequest *IncomingRequestManager::requestFromHostname(const QByteA
 
     Q_ASSERT(hostname == hostname.toLower());
 
-    for (QList<IncomingContactRequest*>::ConstIterator it = m_requests.begin(); it != m_requests.end(); ++it)
-        if ((*it)->hostname() == hostname)
-            return *it;
+    return requestFromAddress(OnionAddress::fromString(hostname));
+}
 
-    return 0;
+IncomingContactRequest *IncomingRequestManager::requestFromAddress(const OnionAddress &address) const
+{
+    return m_requestsByAddress.value(address);
 }
 
 void IncomingRequestManager::requestReceived()
@@ -115,7 +163,8 @@ void IncomingRequestManager::requestReceived()
         return;
     }
 
-    if (isHostnameRejected(hostname.toLatin1())) {
+    OnionAddress address = channel->connection()->authenticatedAddress(Protocol::Connection::HiddenServiceAuth);
+    if (isAddressRejected(address)) {
         qDebug() << "Rejecting contact request due to a blacklist match for" << hostname;
         channel->setResponseStatus(Response::Rejected);
         return;
@@ -127,7 +176,7 @@ void IncomingRequestManager::requestReceived()
         return;
     }
 
-    IncomingContactRequest *request = requestFromHostname(hostname.toLatin1());
+    IncomingContactRequest *request = requestFromAddress(address);
     bool newRequest = false;
 
     if (request) {
@@ -143,7 +192,7 @@ void IncomingRequestManager::requestReceived()
     /* It shouldn't be possible to get an incoming contact request for a known
      * contact, including an outgoing request. Those are implicitly accepted at
      * a different level. */
-    if (contacts->lookupHostname(hostname)) {
+    if (contacts->lookupAddress(address)) {
         BUG() << "Created an inbound contact request matching a known contact; this shouldn't be allowed";
         return;
     }
@@ -152,34 +201,46 @@ void IncomingRequestManager::requestReceived()
     channel->setResponseStatus(Response::Pending);
 
     request->save();
-    if (newRequest) {
-        m_requests.append(request);
-        emit requestAdded(request);
-    }
+    if (newRequest)
+        addRequest(request);
+}
+
+void IncomingRequestManager::addRequest(IncomingContactRequest *request)
+{
+    m_requests.append(request);
+    m_requestsByAddress.insert(OnionAddress::fromString(request->hostname()), request);
+    emit requestAdded(request);
 }
 
 void IncomingRequestManager::removeRequest(IncomingContactRequest *request)
 {
-    if (m_requests.removeOne(request))
+    if (m_requests.removeOne(request)) {
+        m_requestsByAddress.remove(OnionAddress::fromString(request->hostname()));
         emit requestRemoved(request);
+    }
 
     request->deleteLater();
 }
 
 void IncomingRequestManager::addRejectedHost(const QByteArray &hostname)
 {
-    SettingsObject *settings = contacts->identity->settings();
-    QJsonArray blacklist = settings->read<QJsonArray>("hostnameBlacklist");
-    if (!blacklist.contains(QString::fromLatin1(hostname))) {
-        blacklist.append(QString::fromLatin1(hostname));
-        settings->write("hostnameBlacklist", blacklist);
-    }
+    OnionAddress address = OnionAddress::fromString(hostname);
+    if (!address.isValid() || m_rejectedHosts.contains(address))
+        return;
+
+    m_rejectedHosts.insert(address);
+    contacts->identity->settings()->write(QStringLiteral("rejectedHostnames.") + address.serviceID(),
+                                          QDateTime::currentDateTime());
 }
 
 bool IncomingRequestManager::isHostnameRejected(const QByteArray &hostname) const
 {
-    QJsonArray blacklist = contacts->identity->settings()->read<QJsonArray>("hostnameBlacklist");
-    return blacklist.contains(QString::fromLatin1(hostname));
+    return isAddressRejected(OnionAddress::fromString(hostname));
+}
+
+bool IncomingRequestManager::isAddressRejected(const OnionAddress &address) const
+{
+    return m_rejectedHosts.contains(address);
 }
 
 IncomingContactRequest::IncomingContactRequest(IncomingRequestManager *m, const QByteArray &h
@@ -198,7 +259,7 @@ QString IncomingContactRequest::settingsKey() const
 {
     QString key = QString(QLatin1String(m_hostname));
     key.chop(QStringLiteral(".onion").size());
-    return QStringLiteral("contactRequests.%1").arg(key);
+    return manager->contacts->identity->settingsPath(QStringLiteral("contactRequests.%1").arg(key));
 }
 
 void IncomingContactRequest::load()
@@ -215,6 +276,7 @@ void IncomingContactRequest::load()
 void IncomingContactRequest::save()
 {
     SettingsObject settings(settingsKey());
+    SettingsTransaction transaction(&settings);
 
     settings.write("nickname", nickname());
     settings.write("message", message());
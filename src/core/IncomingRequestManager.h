@@ -36,7 +36,10 @@
 #include <QObject>
 #include <QPointer>
 #include <QDateTime>
+#include <QHash>
+#include <QSet>
 #include "protocol/Connection.h"
+#include "utils/OnionAddress.h"
 
 class IncomingRequestManager;
 class ContactsManager;
@@ -135,14 +138,21 @@ public:
 
     /* Hostname is an onion address, including the '.onion' suffix */
     IncomingContactRequest *requestFromHostname(const QByteArray &hostname);
+    IncomingContactRequest *requestFromAddress(const OnionAddress &address) const;
 
     /* Called by ContactsManager to trigger loading past requests from the
      * configuration. */
     void loadRequests();
 
-    /* Blacklist a host for immediate rejection in the future */
+    /* Blacklist a host for immediate rejection in the future
+     *
+     * The blacklist is stored as an object keyed by hostname, without the
+     * '.onion' suffix, under the identity's "rejectedHostnames" setting. Each
+     * value is the time of rejection as an ISO 8601 string; a host is only
+     * rejected while its value is a string. */
     void addRejectedHost(const QByteArray &hostname);
     bool isHostnameRejected(const QByteArray &hostname) const;
+    bool isAddressRejected(const OnionAddress &address) const;
 
 signals:
     void requestAdded(IncomingContactRequest *request);
@@ -151,11 +161,16 @@ signals:
 
 private slots:
     void requestReceived();
+    void onSettingsModified(const QString &key, const QJsonValue &value);
 
 private:
     QList<IncomingContactRequest*> m_requests;
+    QHash<OnionAddress,IncomingContactRequest*> m_requestsByAddress;
+    QSet<OnionAddress> m_rejectedHosts;
 
+    void addRequest(IncomingContactRequest *request);
     void removeRequest(IncomingContactRequest *request);
+    void loadRejectedHosts();
 };
 
 #endif // INCOMINGREQUESTMANAGER_H
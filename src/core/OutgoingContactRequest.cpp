@@ -45,9 +45,12 @@ OutgoingContactRequest *OutgoingContactRequest::createNewRequest(ContactUser *us
     Q_ASSERT(!user->contactRequest());
 
     SettingsObject *settings = user->settings();
-    settings->write("request.status", static_cast<int>(Pending));
-    settings->write("request.myNickname", myNickname);
-    settings->write("request.message", message);
+    {
+        SettingsTransaction transaction(settings);
+        settings->write("request.status", static_cast<int>(Pending));
+        settings->write("request.myNickname", myNickname);
+        settings->write("request.message", message);
+    }
 
     user->loadContactRequest();
     Q_ASSERT(user->contactRequest());
@@ -102,9 +105,7 @@ void OutgoingContactRequest::attemptAutoAccept()
 {
     /* Check if there is an existing incoming request that matches this one; if so, treat this as accepted
      * automatically and accept that incoming request for this user */
-    QByteArray hostname = user->hostname().toLatin1();
-
-    IncomingContactRequest *incomingReq = user->identity->contacts.incomingRequests.requestFromHostname(hostname);
+    IncomingContactRequest *incomingReq = user->identity->contacts.incomingRequests.requestFromAddress(user->onionAddress());
     if (incomingReq)
     {
         qDebug() << "Automatically accepting an incoming contact request matching a newly created outgoing request";
@@ -33,13 +33,18 @@
 #include "UserIdentity.h"
 #include "tor/TorControl.h"
 #include "tor/HiddenService.h"
+#include "tor/TorManager.h"
 #include "core/ContactIDValidator.h"
 #include "protocol/Connection.h"
+#include "protocol/AuthHiddenServiceChannel.h"
 #include "utils/Useful.h"
+#include "utils/UnixSocket.h"
 #include <QTcpServer>
 #include <QTcpSocket>
+#include <QTimer>
 #include <QBuffer>
 #include <QDir>
+#include <QtMath>
 
 using namespace Protocol;
 
@@ -50,13 +55,40 @@ UserIdentity::UserIdentity(int id, QObject *parent)
     , m_settings(0)
     , m_hiddenService(0)
     , m_incomingServer(0)
+    , m_acceptResumeTimer(0)
+    , m_acceptTokens(0)
 {
-    m_settings = new SettingsObject(QStringLiteral("identity"), this);
+    m_settings = new SettingsObject(settingsPath(QStringLiteral("identity")), this);
     connect(m_settings, &SettingsObject::modified, this, &UserIdentity::onSettingsModified);
 
+    m_maxUnauthenticatedConnections = qMax(1, m_settings->read("maxUnauthenticatedConnections",
+                                                               DefaultMaxUnauthenticatedConnections).toInt());
+    m_incomingConnectionRate = qMax(1, m_settings->read("incomingConnectionRate",
+                                                        DefaultIncomingConnectionRate).toInt());
+    m_incomingConnectionBurst = qMax(1, m_settings->read("incomingConnectionBurst",
+                                                         DefaultIncomingConnectionBurst).toInt());
+    m_acceptTokens = m_incomingConnectionBurst;
+    m_acceptClock.start();
+
     QString dir = m_settings->read("dataDirectory", QString::fromLatin1("data-%1").arg(uniqueID)).toString();
+    CryptoKey serviceKey;
+
+    if (m_settings->read("serviceKey").isString()) {
+        QByteArray keyData = QByteArray::fromBase64(m_settings->read("serviceKey").toString().toLatin1());
+        if (!serviceKey.loadFromData(keyData, CryptoKey::PrivateKey, CryptoKey::DER))
+            qWarning("Service key for identity %d is invalid", uniqueID);
+    } else if (m_settings->read("initializing").toBool() && !QDir(dir).exists(QLatin1String("private_key"))) {
+        // New identities keep their key in the configuration and never need Tor to write one
+        if (serviceKey.generateNew()) {
+            m_settings->write("serviceKey", QString::fromLatin1(serviceKey.encodedPrivateKey(CryptoKey::DER).toBase64()));
+            m_settings->write("initializing", QJsonValue::Undefined);
+        }
+    }
 
-    m_hiddenService = new Tor::HiddenService(dir, this);
+    if (serviceKey.isLoaded())
+        m_hiddenService = new Tor::HiddenService(serviceKey, this);
+    else
+        m_hiddenService = new Tor::HiddenService(dir, this);
     connect(m_hiddenService, SIGNAL(statusChanged(int,int)), SLOT(onStatusChanged(int,int)));
 
     // Generally, these are not used, and we bind to localhost and port 0
@@ -75,32 +107,68 @@ UserIdentity::UserIdentity(int id, QObject *parent)
     else
     {
         m_incomingServer = new QTcpServer(this);
-        if (!m_incomingServer->listen(address, port)) {
-            qWarning() << "Failed to open incoming socket:" << m_incomingServer->errorString();
-            return;
+
+        /* With tor.unixSockets, Tor reaches the service through a unix socket
+         * instead of a port on localhost. ADD_ONION can't quote a path with
+         * spaces, so those fall back to TCP. */
+        QString listenPath = m_settings->read("localListenPath").toString();
+        if (listenPath.isEmpty() && SettingsObject(QStringLiteral("tor")).read("unixSockets").toBool()
+            && isUnixSocketSupported())
+        {
+            listenPath = QDir(Tor::TorManager::instance()->dataDirectory())
+                         .absoluteFilePath(QStringLiteral("service-%1.sock").arg(uniqueID));
+        }
+
+        QString errorMessage;
+        if (!listenPath.isEmpty() && !listenPath.contains(QLatin1Char(' '))
+            && listenUnixSocket(m_incomingServer, listenPath, &errorMessage))
+        {
+            m_hiddenService->addTarget(9878, listenPath);
+        } else {
+            if (!listenPath.isEmpty())
+                qWarning() << "Failed to open incoming unix socket, using TCP instead:" << errorMessage;
+
+            if (!m_incomingServer->listen(address, port)) {
+                qWarning() << "Failed to open incoming socket:" << m_incomingServer->errorString();
+                return;
+            }
+            m_hiddenService->addTarget(9878, m_incomingServer->serverAddress(), m_incomingServer->serverPort());
         }
 
         connect(m_incomingServer, &QTcpServer::newConnection, this, &UserIdentity::onIncomingConnection);
 
-        m_hiddenService->addTarget(9878, m_incomingServer->serverAddress(), m_incomingServer->serverPort());
+        m_acceptResumeTimer = new QTimer(this);
+        m_acceptResumeTimer->setSingleShot(true);
+        connect(m_acceptResumeTimer, &QTimer::timeout, this,
+            [this]() {
+                m_incomingServer->resumeAccepting();
+                onIncomingConnection();
+            }
+        );
+
         torControl->addHiddenService(m_hiddenService);
     }
 
     contacts.loadFromSettings();
 }
 
+QString UserIdentity::settingsPath(int uniqueID, const QString &key)
+{
+    if (uniqueID == 0)
+        return key;
+    return QStringLiteral("identities.%1.%2").arg(uniqueID).arg(key);
+}
+
 UserIdentity *UserIdentity::createIdentity(int uniqueID, const QString &dataDirectory)
 {
-    // There is actually no support for multiple identities currently.
-    Q_ASSERT(uniqueID == 0);
-    if (uniqueID != 0)
+    Q_ASSERT(uniqueID >= 0);
+    if (uniqueID < 0)
         return 0;
 
-    SettingsObject settings(QStringLiteral("identity"));
+    SettingsObject settings(settingsPath(uniqueID, QStringLiteral("identity")));
     settings.write("initializing", true);
-    if (dataDirectory.isEmpty())
-        settings.write("dataDirectory", QString::fromLatin1("data-%1").arg(uniqueID));
-    else
+    // Without a data directory, a key is generated for the identity in memory
+    if (!dataDirectory.isEmpty())
         settings.write("dataDirectory", dataDirectory);
 
     return new UserIdentity(uniqueID);
@@ -163,10 +231,32 @@ bool UserIdentity::isServiceOnline() const
  * If the connection successfully completes authentication,
  * handleIncomingAuthedConnection is called to link it to a ContactUser
  * (if applicable) and set the purpose.
+ *
+ * Accepting is rate limited by a token bucket; when it's empty, the server
+ * stops accepting and sockets wait in the listen backlog until a token is
+ * available. At most m_maxUnauthenticatedConnections may be waiting for a
+ * purpose at once, and the oldest of those is closed to make room for a new
+ * one. Connections from known contacts are claimed once they authenticate;
+ * until then they look like any other, so a connection whose proof is being
+ * verified is never evicted. Nothing is known about a socket before it's
+ * accepted, so contacts do share the accept rate limit with everyone else.
  */
 void UserIdentity::onIncomingConnection()
 {
     while (m_incomingServer->hasPendingConnections()) {
+        int waitMsec = 0;
+        if (!takeAcceptToken(&waitMsec)) {
+            if (!m_acceptResumeTimer->isActive()) {
+                qDebug() << "Incoming connection rate limit reached, delaying accept for" << waitMsec << "ms";
+                m_incomingServer->pauseAccepting();
+                m_acceptResumeTimer->start(waitMsec);
+            }
+            return;
+        }
+
+        if (unauthenticatedConnectionCount() >= m_maxUnauthenticatedConnections)
+            evictUnauthenticatedConnection();
+
         QTcpSocket *socket = m_incomingServer->nextPendingConnection();
 
         /* The localHostname property is used by Connection to determine the
@@ -193,6 +283,21 @@ void UserIdentity::onIncomingConnection()
             }
         );
 
+        // Refuse authentication from hosts that were blacklisted by rejecting their contact request
+        connect(connPtr, &Connection::channelCreated, this,
+            [this](Channel *channel) {
+                AuthHiddenServiceChannel *auth = qobject_cast<AuthHiddenServiceChannel*>(channel);
+                if (!auth || auth->direction() != Channel::Inbound)
+                    return;
+                auth->setRejectedIdentityFilter(
+                    [this](const QString &serviceID) {
+                        OnionAddress address = OnionAddress::fromString(serviceID);
+                        return !contacts.lookupAddress(address) && contacts.incomingRequests.isAddressRejected(address);
+                    }
+                );
+            }
+        );
+
         connect(connPtr, &Connection::authenticated, this,
             [this,connPtr](Connection::AuthenticationType type) {
                 if (type == Connection::HiddenServiceAuth)
@@ -215,7 +320,7 @@ void UserIdentity::handleIncomingAuthedConnection(Connection *conn)
         return;
     }
 
-    ContactUser *user = contacts.lookupHostname(clientName);
+    ContactUser *user = contacts.lookupAddress(conn->authenticatedAddress(Connection::HiddenServiceAuth));
     if (!user) {
         // This client can start a contact request, for example. The purpose stays unknown, and the
         // connection will be killed if the purpose isn't changed before the timeout.
@@ -233,6 +338,61 @@ void UserIdentity::handleIncomingAuthedConnection(Connection *conn)
     user->assignConnection(connPtr);
 }
 
+bool UserIdentity::takeAcceptToken(int *waitMsec)
+{
+    qint64 elapsed = m_acceptClock.restart();
+    m_acceptTokens = qMin<double>(m_incomingConnectionBurst,
+                                  m_acceptTokens + elapsed * m_incomingConnectionRate / 1000.0);
+
+    if (m_acceptTokens >= 1) {
+        m_acceptTokens -= 1;
+        return true;
+    }
+
+    *waitMsec = qCeil((1 - m_acceptTokens) * 1000 / m_incomingConnectionRate);
+    return false;
+}
+
+int UserIdentity::unauthenticatedConnectionCount() const
+{
+    int count = 0;
+    foreach (const QSharedPointer<Connection> &conn, m_incomingConnections) {
+        if (conn->isConnected() && conn->purpose() == Connection::Purpose::Unknown)
+            count++;
+    }
+    return count;
+}
+
+/* Close the oldest connection that is still waiting for a purpose,
+ * preferring those which have not authenticated at all over clients that
+ * authenticated but haven't yet made a request. Connections with a proof
+ * being verified may be contacts, and are left alone; if every connection
+ * is in that state, none is closed.
+ */
+void UserIdentity::evictUnauthenticatedConnection()
+{
+    Connection *victim = 0;
+    foreach (const QSharedPointer<Connection> &conn, m_incomingConnections) {
+        if (!conn->isConnected() || conn->purpose() != Connection::Purpose::Unknown)
+            continue;
+        AuthHiddenServiceChannel *auth = conn->findChannel<AuthHiddenServiceChannel>(Channel::Inbound);
+        if (auth && auth->isVerifying())
+            continue;
+        if (!conn->hasAuthenticated(Connection::HiddenServiceAuth)) {
+            victim = conn.data();
+            break;
+        }
+        if (!victim)
+            victim = conn.data();
+    }
+
+    if (victim) {
+        qDebug() << "Closing incoming connection" << victim << "with unknown purpose to admit a new connection; age"
+                 << victim->age() << "seconds";
+        victim->close();
+    }
+}
+
 QSharedPointer<Connection> UserIdentity::takeIncomingConnection(Connection *match)
 {
     for (auto it = m_incomingConnections.begin(); it != m_incomingConnections.end(); it++) {
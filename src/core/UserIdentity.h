@@ -38,6 +38,7 @@
 #include <QMetaType>
 #include <QVector>
 #include <QSharedPointer>
+#include <QElapsedTimer>
 
 namespace Tor
 {
@@ -50,15 +51,15 @@ namespace Protocol
 }
 
 class QTcpServer;
+class QTimer;
 
 /* UserIdentity represents the local identity offered by the user.
  *
  * In particular, it represents the published hidden service, and
- * theoretically holds the list of contacts.
+ * holds the list of contacts.
  *
- * At present, implementation (and settings) assumes that there is
- * only one identity, but some code is confusingly written to allow
- * for several.
+ * Any number of identities can share one Tor instance. Each has its own
+ * service, listening socket and settings; see settingsPath().
  */
 class UserIdentity : public QObject
 {
@@ -97,6 +98,12 @@ public:
 
     SettingsObject *settings();
 
+    /* Path of a key in this identity's settings subtree. The first identity
+     * keeps the top-level "identity", "contacts" and "contactRequests" keys
+     * used before there were several; others are under "identities.<id>". */
+    QString settingsPath(const QString &key) const { return settingsPath(uniqueID, key); }
+    static QString settingsPath(int uniqueID, const QString &key);
+
     /* Take ownership of an inbound connection. Returns the shared pointer to
      * the connection, and releases the reference held by UserIdentity. */
     QSharedPointer<Protocol::Connection> takeIncomingConnection(Protocol::Connection *connection);
@@ -114,14 +121,31 @@ private slots:
     void onIncomingConnection();
 
 private:
+    /* Defaults for admission control of inbound connections; each may be
+     * overridden by the identity setting of the same name. */
+    static const int DefaultMaxUnauthenticatedConnections = 30;
+    static const int DefaultIncomingConnectionRate = 5; // per second
+    static const int DefaultIncomingConnectionBurst = 20;
+
     SettingsObject *m_settings;
     Tor::HiddenService *m_hiddenService;
     QTcpServer *m_incomingServer;
     QVector<QSharedPointer<Protocol::Connection>> m_incomingConnections;
 
+    /* Token bucket limiting the rate of accepted inbound connections */
+    QTimer *m_acceptResumeTimer;
+    QElapsedTimer m_acceptClock;
+    double m_acceptTokens;
+    int m_maxUnauthenticatedConnections;
+    int m_incomingConnectionRate;
+    int m_incomingConnectionBurst;
+
     static UserIdentity *createIdentity(int uniqueID, const QString &dataDirectory = QString());
 
     void handleIncomingAuthedConnection(Protocol::Connection *connection);
+    bool takeAcceptToken(int *waitMsec);
+    int unauthenticatedConnectionCount() const;
+    void evictUnauthenticatedConnection();
 };
 
 Q_DECLARE_METATYPE(UserIdentity*)
@@ -35,12 +35,13 @@
 #include "tor/TorManager.h"
 #include "tor/TorControl.h"
 #include "utils/CryptoKey.h"
+#include "utils/CryptoExecutor.h"
 #include "utils/SecureRNG.h"
 #include "utils/Settings.h"
+#include "utils/LegacySettings.h"
 #include <QApplication>
 #include <QIcon>
 #include <QLibraryInfo>
-#include <QSettings>
 #include <QTime>
 #include <QDir>
 #include <QTranslator>
@@ -51,7 +52,6 @@
 #include <openssl/crypto.h>
 
 static bool initSettings(SettingsFile *settings, QLockFile **lockFile, QString &errorMessage);
-static bool importLegacySettings(SettingsFile *settings, const QString &oldPath);
 static void initTranslation();
 
 int main(int argc, char *argv[])
@@ -75,10 +75,20 @@ int main(int argc, char *argv[])
     }
     QScopedPointer<QLockFile> lockFile(lock);
 
+    /* Runtime state is checkpointed separately from the configuration */
+    QScopedPointer<SettingsFile> stateFile(new SettingsFile);
+    stateFile->setSyncInterval(60000);
+    if (stateFile->setFilePath(QFileInfo(settings->filePath()).dir().filePath(QStringLiteral("ricochet-state.json"))))
+        SettingsObject::setStateFile(stateFile.data());
+    else
+        qWarning() << "Cannot use state file; storing runtime state with the configuration:" << stateFile->errorMessage();
+
     initTranslation();
 
     /* Initialize OpenSSL's allocator */
     CRYPTO_malloc_init();
+    /* Required before crypto is used from the worker and network threads */
+    CryptoExecutor::initializeThreading();
 
     /* Seed the OpenSSL RNG */
     if (!SecureRNG::seed())
@@ -193,6 +203,10 @@ static bool initSettings(SettingsFile *settings, QLockFile **lockFile, QString &
         }
     }
 
+    // Opt-in binary snapshot of the configuration, for faster loading with large configurations
+    if (qgetenv("RICOCHET_SETTINGS_FORMAT") == "binary")
+        settings->setFormat(SettingsFile::BinaryFormat);
+
     settings->setFilePath(dir.filePath(QStringLiteral("ricochet.json")));
     if (settings->hasError()) {
         errorMessage = settings->errorMessage();
@@ -210,94 +224,6 @@ static bool initSettings(SettingsFile *settings, QLockFile **lockFile, QString &
     return true;
 }
 
-static void copyKeys(QSettings &old, SettingsObject *object)
-{
-    foreach (const QString &key, old.childKeys()) {
-        QVariant value = old.value(key);
-        if ((QMetaType::Type)value.type() == QMetaType::QDateTime)
-            object->write(key, value.toDateTime());
-        else if ((QMetaType::Type)value.type() == QMetaType::QByteArray)
-            object->write(key, Base64Encode(value.toByteArray()));
-        else
-            object->write(key, value.toString());
-    }
-}
-
-static bool importLegacySettings(SettingsFile *settings, const QString &oldPath)
-{
-    QSettings old(oldPath, QSettings::IniFormat);
-    SettingsObject *root = settings->root();
-    QVariant value;
-
-    qDebug() << "Importing legacy format settings from" << oldPath;
-
-    if (!(value = old.value(QStringLiteral("tor/controlIp"))).isNull())
-        root->write("tor.controlAddress", value.toString());
-    if (!(value = old.value(QStringLiteral("tor/controlPort"))).isNull())
-        root->write("tor.controlPort", value.toInt());
-    if (!(value = old.value(QStringLiteral("tor/authPassword"))).isNull())
-        root->write("tor.controlPassword", value.toString());
-    if (!(value = old.value(QStringLiteral("tor/socksIp"))).isNull())
-        root->write("tor.socksAddress", value.toString());
-    if (!(value = old.value(QStringLiteral("tor/socksPort"))).isNull())
-        root->write("tor.socksPort", value.toInt());
-    if (!(value = old.value(QStringLiteral("tor/executablePath"))).isNull())
-        root->write("tor.executablePath", value.toString());
-    if (!(value = old.value(QStringLiteral("core/neverPublishService"))).isNull())
-        root->write("tor.neverPublishServices", value.toBool());
-    if (!(value = old.value(QStringLiteral("identity/0/dataDirectory"))).isNull())
-        root->write("identity.dataDirectory", value.toString());
-    if (!(value = old.value(QStringLiteral("identity/0/createNewService"))).isNull())
-        root->write("identity.initializing", value.toBool());
-    if (!(value = old.value(QStringLiteral("core/listenIp"))).isNull())
-        root->write("identity.localListenAddress", value.toString());
-    if (!(value = old.value(QStringLiteral("core/listenPort"))).isNull())
-        root->write("identity.localListenPort", value.toInt());
-
-    {
-        old.beginGroup(QStringLiteral("contacts"));
-        QStringList ids = old.childGroups();
-        foreach (const QString &id, ids) {
-            old.beginGroup(id);
-            SettingsObject userObject(root, QStringLiteral("contacts.%1").arg(id));
-
-            copyKeys(old, &userObject);
-
-            if (old.childGroups().contains(QStringLiteral("request"))) {
-                old.beginGroup(QStringLiteral("request"));
-                QStringList requestKeys = old.childKeys();
-                foreach (const QString &key, requestKeys)
-                    userObject.write(QStringLiteral("request.") + key, old.value(key).toString());
-                old.endGroup();
-            }
-
-            old.endGroup();
-        }
-        old.endGroup();
-    }
-
-    {
-        old.beginGroup(QStringLiteral("contactRequests"));
-        QStringList contacts = old.childGroups();
-
-        foreach (const QString &hostname, contacts) {
-            old.beginGroup(hostname);
-            SettingsObject requestObject(root, QStringLiteral("contactRequests.%1").arg(hostname));
-            copyKeys(old, &requestObject);
-            old.endGroup();
-        }
-
-        old.endGroup();
-    }
-
-    if (!(value = old.value(QStringLiteral("core/hostnameBlacklist"))).isNull()) {
-        QStringList blacklist = value.toStringList();
-        root->write("identity.hostnameBlacklist", QJsonArray::fromStringList(blacklist));
-    }
-
-    return true;
-}
-
 static void initTranslation()
 {
     QTranslator *translator = new QTranslator;
@@ -36,6 +36,7 @@
 #include "Channel_p.h"
 #include "utils/SecureRNG.h"
 #include "utils/CryptoKey.h"
+#include "utils/CryptoExecutor.h"
 #include "utils/Useful.h"
 #include <QMessageAuthenticationCode>
 
@@ -48,15 +49,32 @@ class AuthHiddenServiceChannelPrivate : public ChannelPrivate
 public:
     CryptoKey privateKey;
     QByteArray clientCookie, serverCookie;
+    std::function<bool(const QString &serviceID)> rejectedIdentityFilter;
     bool accepted;
+    // Set while a signature is being created or verified on the crypto thread pool
+    bool cryptoPending;
 
     AuthHiddenServiceChannelPrivate(Channel *q, Channel::Direction direction, Connection *conn)
         : ChannelPrivate(q, QStringLiteral("im.ricochet.auth.hidden-service"), direction, conn)
         , accepted(false)
+        , cryptoPending(false)
     {
     }
 
     QByteArray getProofData(const QString &clientHostname);
+    bool isRejectedIdentity(const QString &serviceID) const
+    {
+        return rejectedIdentityFilter && rejectedIdentityFilter(serviceID);
+    }
+    static QByteArray getProofData(const QString &clientHostname, const QString &serverHostname);
+};
+
+struct ProofVerification
+{
+    QString serviceID;
+    bool ok;
+
+    ProofVerification() : ok(false) { }
 };
 
 }
@@ -94,6 +112,18 @@ void AuthHiddenServiceChannel::setPrivateKey(const CryptoKey &key)
     d->privateKey = key;
 }
 
+void AuthHiddenServiceChannel::setRejectedIdentityFilter(const std::function<bool(const QString &serviceID)> &filter)
+{
+    Q_D(AuthHiddenServiceChannel);
+    d->rejectedIdentityFilter = filter;
+}
+
+bool AuthHiddenServiceChannel::isVerifying() const
+{
+    Q_D(const AuthHiddenServiceChannel);
+    return direction() == Inbound && d->cryptoPending;
+}
+
 bool AuthHiddenServiceChannel::allowInboundChannelRequest(const Data::Control::OpenChannel *request, Data::Control::ChannelResult *result)
 {
     Q_D(AuthHiddenServiceChannel);
@@ -193,6 +223,11 @@ void AuthHiddenServiceChannel::sendAuthMessage()
         return;
     }
 
+    if (d->cryptoPending) {
+        BUG() << "AuthHiddenServiceChannel is already creating a proof";
+        return;
+    }
+
     QByteArray publicKey = d->privateKey.encodedPublicKey(CryptoKey::DER);
     if (publicKey.size() > 150) {
         BUG() << "Unexpected size for encoded public key";
@@ -200,34 +235,57 @@ void AuthHiddenServiceChannel::sendAuthMessage()
         return;
     }
 
-    QByteArray signature;
     QByteArray proofData = d->getProofData(d->privateKey.torServiceID());
-    if (!proofData.isEmpty()) {
-        QByteArray proofHMAC = QMessageAuthenticationCode::hash(proofData, d->clientCookie + d->serverCookie,
-                QCryptographicHash::Sha256);
-        signature = d->privateKey.signSHA256(proofHMAC);
-    }
-
-    if (signature.isEmpty()) {
+    if (proofData.isEmpty()) {
         BUG() << "Creating proof on AuthHiddenServiceChannel failed";
         closeChannel();
         return;
     }
 
-    QScopedPointer<Data::AuthHiddenService::Proof> proof(new Data::AuthHiddenService::Proof);
-    proof->set_public_key(std::string(publicKey.constData(), publicKey.size()));
-    proof->set_signature(std::string(signature.constData(), signature.size()));
+    QByteArray proofHMAC = QMessageAuthenticationCode::hash(proofData, d->clientCookie + d->serverCookie,
+            QCryptographicHash::Sha256);
+
+    // Signing is done on the crypto thread pool; the proof is sent when it finishes,
+    // unless the channel has been closed (or destroyed) in the meantime.
+    d->cryptoPending = true;
+    CryptoKey privateKey = d->privateKey;
+    CryptoExecutor::run(this,
+        [privateKey,proofHMAC]() {
+            return privateKey.signSHA256(proofHMAC);
+        },
+        [this,publicKey](const QByteArray &signature) {
+            Q_D(AuthHiddenServiceChannel);
+            d->cryptoPending = false;
+            if (!isOpened())
+                return;
+
+            if (signature.isEmpty()) {
+                BUG() << "Creating proof on AuthHiddenServiceChannel failed";
+                closeChannel();
+                return;
+            }
 
-    Data::AuthHiddenService::Packet message;
-    message.set_allocated_proof(proof.take());
-    sendMessage(message);
+            QScopedPointer<Data::AuthHiddenService::Proof> proof(new Data::AuthHiddenService::Proof);
+            proof->set_public_key(std::string(publicKey.constData(), publicKey.size()));
+            proof->set_signature(std::string(signature.constData(), signature.size()));
+
+            Data::AuthHiddenService::Packet message;
+            message.set_allocated_proof(proof.take());
+            sendMessage(message);
 
-    qDebug() << "AuthHiddenServiceChannel sent outbound authentication packet";
+            qDebug() << "AuthHiddenServiceChannel sent outbound authentication packet";
+        }
+    );
 }
 
 QByteArray AuthHiddenServiceChannelPrivate::getProofData(const QString &client)
 {
-    QByteArray serverHostname = connection->serverHostname().toLatin1().mid(0, 16);
+    return getProofData(client, connection->serverHostname());
+}
+
+QByteArray AuthHiddenServiceChannelPrivate::getProofData(const QString &client, const QString &server)
+{
+    QByteArray serverHostname = server.toLatin1().mid(0, 16);
     QByteArray clientHostname = client.toLatin1();
 
     if (clientHostname.size() != 16 || serverHostname.size() != 16) {
@@ -272,42 +330,90 @@ void AuthHiddenServiceChannel::handleProof(const Data::AuthHiddenService::Proof
         return;
     }
 
+    if (d->cryptoPending) {
+        qWarning() << "Received another proof on" << type() << "while verifying the first";
+        closeChannel();
+        return;
+    }
+
     QByteArray publicKeyData(message.public_key().c_str(), message.public_key().size());
     QByteArray signature(message.signature().c_str(), message.signature().size());
 
-    QScopedPointer<Data::AuthHiddenService::Result> result(new Data::AuthHiddenService::Result);
-    result->set_accepted(false);
-
     // Hidden services always use a 1024bit key. A valid signature will always be exactly 128 bytes.
-    CryptoKey publicKey;
     if (signature.size() != 128) {
         qWarning() << "Received invalid signature (size" << signature.size() << ") on" << type();
+        sendResult(false);
+        return;
     } else if (publicKeyData.size() > 150) {
         qWarning() << "Received invalid public key (size" << publicKeyData.size() << ") on" << type();
-    } else if (!publicKey.loadFromData(publicKeyData, CryptoKey::PublicKey, CryptoKey::DER)) {
-        qWarning() << "Unable to parse public key from" << type();
-    } else if (publicKey.bits() != 1024) {
-        qWarning() << "Received invalid public key (" << publicKey.bits() << "bits) on" << type();
-    } else {
-        bool ok = false;
-        QByteArray proofData = d->getProofData(publicKey.torServiceID());
-        if (!proofData.isEmpty()) {
-            QByteArray proofHMAC = QMessageAuthenticationCode::hash(proofData, d->clientCookie + d->serverCookie,
-                    QCryptographicHash::Sha256);
-            ok = publicKey.verifySHA256(proofHMAC, signature);
-        }
+        sendResult(false);
+        return;
+    }
 
-        if (!ok) {
-            qWarning() << "Signature verification failed on" << type();
-            result->set_accepted(false);
-        } else {
-            result->set_accepted(true);
-            qDebug() << type() << "accepted inbound authentication for" << publicKey.torServiceID();
-        }
+    QString cachedServiceID = CryptoKey::cachedServiceID(publicKeyData);
+    if (!cachedServiceID.isEmpty() && d->isRejectedIdentity(cachedServiceID)) {
+        qDebug() << type() << "rejecting authentication from blocked identity" << cachedServiceID << "without verifying";
+        sendResult(false);
+        return;
     }
 
-    if (result->accepted()) {
-        connection()->grantAuthentication(Connection::HiddenServiceAuth, publicKey.torServiceID() + QStringLiteral(".onion"));
+    // Parsing the key and verifying the signature are done on the crypto thread pool,
+    // and the channel waits for the result before replying.
+    d->cryptoPending = true;
+    QString serverHostname = connection()->serverHostname();
+    QByteArray cookies = d->clientCookie + d->serverCookie;
+    QString channelType = type();
+    CryptoExecutor::run(this,
+        [publicKeyData,signature,serverHostname,cookies,channelType]() -> ProofVerification {
+            ProofVerification re;
+            CryptoKey publicKey;
+            if (!publicKey.loadFromData(publicKeyData, CryptoKey::PublicKey, CryptoKey::DER)) {
+                qWarning() << "Unable to parse public key from" << channelType;
+                return re;
+            } else if (publicKey.bits() != 1024) {
+                qWarning() << "Received invalid public key (" << publicKey.bits() << "bits) on" << channelType;
+                return re;
+            }
+
+            re.serviceID = publicKey.torServiceID();
+            QByteArray proofData = AuthHiddenServiceChannelPrivate::getProofData(re.serviceID, serverHostname);
+            if (!proofData.isEmpty()) {
+                QByteArray proofHMAC = QMessageAuthenticationCode::hash(proofData, cookies, QCryptographicHash::Sha256);
+                re.ok = publicKey.verifySHA256(proofHMAC, signature);
+            }
+
+            if (!re.ok)
+                qWarning() << "Signature verification failed on" << channelType;
+            return re;
+        },
+        [this](const ProofVerification &verification) {
+            Q_D(AuthHiddenServiceChannel);
+            d->cryptoPending = false;
+            if (!isOpened())
+                return;
+
+            if (verification.ok && d->isRejectedIdentity(verification.serviceID)) {
+                qDebug() << type() << "rejecting authentication from blocked identity" << verification.serviceID;
+                sendResult(false);
+                return;
+            }
+
+            if (verification.ok)
+                qDebug() << type() << "accepted inbound authentication for" << verification.serviceID;
+            sendResult(verification.ok, verification.serviceID);
+        }
+    );
+}
+
+void AuthHiddenServiceChannel::sendResult(bool accepted, const QString &serviceID)
+{
+    Q_D(AuthHiddenServiceChannel);
+
+    QScopedPointer<Data::AuthHiddenService::Result> result(new Data::AuthHiddenService::Result);
+    result->set_accepted(accepted);
+
+    if (accepted) {
+        connection()->grantAuthentication(Connection::HiddenServiceAuth, serviceID + QStringLiteral(".onion"));
         d->accepted = true;
         result->set_is_known_contact(connection()->purpose() == Connection::Purpose::KnownContact);
     } else {
@@ -36,6 +36,7 @@
 #include "Channel.h"
 #include "utils/CryptoKey.h"
 #include "AuthHiddenService.pb.h"
+#include <functional>
 
 namespace Protocol
 {
@@ -53,6 +54,15 @@ public:
 
     void setPrivateKey(const CryptoKey &key);
 
+    /* For inbound channels, reject the proof of any identity for which
+     * 'filter' returns true. The service ID is passed without ".onion".
+     * Keys already in CryptoKey's service ID cache are rejected before
+     * their signature is verified. */
+    void setRejectedIdentityFilter(const std::function<bool(const QString &serviceID)> &filter);
+
+    /* True while a proof received on an inbound channel is being verified */
+    bool isVerifying() const;
+
 signals:
     void authSuccessful();
     void authFailed();
@@ -69,6 +79,7 @@ protected:
 private:
     void handleProof(const Data::AuthHiddenService::Proof &message);
     void handleResult(const Data::AuthHiddenService::Result &message);
+    void sendResult(bool accepted, const QString &serviceID = QString());
 };
 
 }
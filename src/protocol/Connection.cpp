@@ -35,6 +35,8 @@
 #include "utils/Useful.h"
 #include <QTcpSocket>
 #include <QTimer>
+#include <QThread>
+#include <QCoreApplication>
 #include <QtEndian>
 #include <QDebug>
 
@@ -51,6 +53,8 @@ ConnectionPrivate::ConnectionPrivate(Connection *qq)
     : QObject(qq)
     , q(qq)
     , socket(0)
+    , io(0)
+    , ioConnected(false)
     , direction(Connection::ClientSide)
     , purpose(Connection::Purpose::Unknown)
     , wasClosed(false)
@@ -98,6 +102,10 @@ Connection::~Connection()
 
 ConnectionPrivate::~ConnectionPrivate()
 {
+    // ConnectionIO and the socket are deleted on the network thread
+    if (io)
+        io->deleteLater();
+
     // Reset q pointer, for the same reason as above
     q = 0;
 }
@@ -109,7 +117,11 @@ Connection::Direction Connection::direction() const
 
 bool Connection::isConnected() const
 {
-    bool re = d->socket && d->socket->state() == QAbstractSocket::ConnectedState;
+    bool re;
+    if (d->io)
+        re = d->ioConnected;
+    else
+        re = d->socket && d->socket->state() == QAbstractSocket::ConnectedState;
     if (d->wasClosed) {
         Q_ASSERT(!re);
     }
@@ -118,12 +130,7 @@ bool Connection::isConnected() const
 
 QString Connection::serverHostname() const
 {
-    QString hostname;
-    if (direction() == ClientSide)
-        hostname = d->socket->peerName();
-    else if (direction() == ServerSide)
-        hostname = d->socket->property("localHostname").toString();
-
+    const QString &hostname = d->serverHostname;
     if (!hostname.endsWith(QStringLiteral(".onion"))) {
         BUG() << "Connection does not have a valid server hostname:" << hostname;
         return QString();
@@ -146,6 +153,11 @@ void ConnectionPrivate::setSocket(QTcpSocket *s, Connection::Direction d)
 
     socket = s;
     direction = d;
+    // Cached, because the socket can't be used from this thread after negotiation
+    if (direction == Connection::ClientSide)
+        serverHostname = socket->peerName();
+    else
+        serverHostname = socket->property("localHostname").toString();
     connect(socket, &QAbstractSocket::disconnected, this, &ConnectionPrivate::socketDisconnected);
     connect(socket, &QIODevice::readyRead, this, &ConnectionPrivate::socketReadable);
 
@@ -192,7 +204,12 @@ void Connection::close()
     if (isConnected()) {
         Q_ASSERT(!d->wasClosed);
         qDebug() << "Disconnecting socket for connection" << this;
-        d->socket->disconnectFromHost();
+        if (d->io) {
+            d->ioConnected = false;
+            QMetaObject::invokeMethod(d->io, "disconnectFromHost", Qt::QueuedConnection);
+        } else {
+            d->socket->disconnectFromHost();
+        }
 
         // If not fully closed in 5 seconds, abort
         QTimer *timeout = new QTimer(this);
@@ -204,8 +221,7 @@ void Connection::close()
 
 void ConnectionPrivate::closeImmediately()
 {
-    if (socket)
-        socket->abort();
+    abortSocket();
 
     if (!wasClosed) {
         BUG() << "Socket was forcefully closed but never emitted closed signal";
@@ -220,8 +236,37 @@ void ConnectionPrivate::closeImmediately()
     }
 }
 
+/* Abort the socket, as QAbstractSocket::abort does: the connection is closed
+ * before this returns, even if the socket is on the network thread. */
+void ConnectionPrivate::abortSocket()
+{
+    if (io) {
+        ioConnected = false;
+        QMetaObject::invokeMethod(io, "abort", Qt::QueuedConnection);
+        socketDisconnected();
+    } else if (socket) {
+        socket->abort();
+    }
+}
+
+void ConnectionPrivate::ioDisconnected()
+{
+    if (wasClosed)
+        return;
+
+    // Packets read before the socket closed are still delivered
+    ioConnected = false;
+    handlePackets(false);
+    socketDisconnected();
+}
+
 void ConnectionPrivate::socketDisconnected()
 {
+    // With the socket on the network thread, this is called when closing
+    // and again when the socket reports it
+    if (wasClosed && channels.isEmpty())
+        return;
+
     qDebug() << "Connection" << this << "disconnected";
     closeAllChannels();
 
@@ -256,8 +301,11 @@ void ConnectionPrivate::socketReadable()
                 emit q->versionNegotiationFailed();
                 socket->abort();
                 return;
-            } else
+            } else {
+                moveToNetworkThread();
                 emit q->ready();
+                return;
+            }
         } else if (direction == Connection::ServerSide && available >= 3) {
             // Expecting at least 3 bytes
             uchar intro[3] = { 0 };
@@ -311,33 +359,223 @@ void ConnectionPrivate::socketReadable()
                 // Close gracefully to allow the response to write
                 q->close();
                 return;
-            } else
+            } else {
+                moveToNetworkThread();
                 emit q->ready();
+                return;
+            }
         } else {
             return;
         }
     }
 
+    // Negotiation failed and the socket is closing; ignore anything else
+    // the peer sends
+}
+
+void ConnectionPrivate::moveToNetworkThread()
+{
+    // Anything the peer sent after its handshake is still in the socket's
+    // buffer, and is read by ConnectionIO::start
+    socket->disconnect(this);
+    socket->setParent(0);
+
+    incoming = QSharedPointer<IncomingPackets>(new IncomingPackets);
+    io = new ConnectionIO(socket, incoming);
+    ioConnected = socket->state() == QAbstractSocket::ConnectedState;
+    socket = 0;
+
+    connect(io, &ConnectionIO::packetsAvailable, this, &ConnectionPrivate::packetsAvailable);
+    connect(io, &ConnectionIO::disconnected, this, &ConnectionPrivate::ioDisconnected);
+
+    io->moveToThread(ConnectionIO::networkThread());
+    QMetaObject::invokeMethod(io, "start", Qt::QueuedConnection);
+}
+
+void ConnectionPrivate::packetsAvailable()
+{
+    handlePackets(true);
+}
+
+/* Handle packets queued by ConnectionIO
+ *
+ * With limitTime, this returns to the event loop after a few milliseconds
+ * and continues later, so a burst of packets can't hold up the UI.
+ */
+void ConnectionPrivate::handlePackets(bool limitTime)
+{
+    static const int timeLimit = 8;
+    QElapsedTimer timer;
+    timer.start();
+
+    while (!wasClosed) {
+        if (limitTime && timer.elapsed() >= timeLimit) {
+            // 'notified' stays set, so ConnectionIO won't notify again in the meantime
+            QMetaObject::invokeMethod(this, "packetsAvailable", Qt::QueuedConnection);
+            return;
+        }
+
+        QPair<int,QByteArray> packet;
+        bool resume = false;
+        {
+            QMutexLocker locker(&incoming->mutex);
+            if (incoming->packets.isEmpty()) {
+                incoming->notified = false;
+                return;
+            }
+
+            packet = incoming->packets.takeFirst();
+            incoming->size -= packet.second.size();
+            if (incoming->paused && incoming->size < ConnectionIO::MaxQueuedBytes / 2) {
+                incoming->paused = false;
+                resume = true;
+            }
+        }
+
+        if (resume && ioConnected)
+            QMetaObject::invokeMethod(io, "resume", Qt::QueuedConnection);
+
+        handlePacket(packet.first, packet.second);
+    }
+}
+
+void ConnectionPrivate::handlePacket(int channelId, const QByteArray &data)
+{
+    Channel *channel = q->channel(channelId);
+    if (!channel) {
+        // XXX We should sanity-check and rate limit these responses better
+        if (data.isEmpty()) {
+            qDebug() << "Ignoring channel close message for non-existent channel" << channelId;
+        } else {
+            qDebug() << "Ignoring" << data.size() << "byte packet for non-existent channel" << channelId;
+            // Send channel close message
+            writePacket(channelId, QByteArray());
+        }
+        return;
+    }
+
+    if (channel->connection() != q) {
+        // If this fails, something is extremely broken. It may be dangerous to continue
+        // processing any data at all. Crash gracefully.
+        BUG() << "Channel" << channelId << "found on connection" << this << "but its connection is"
+              << channel->connection();
+        qFatal("Connection mismatch while handling packet");
+        return;
+    }
+
+    if (data.isEmpty()) {
+        channel->closeChannel();
+    } else {
+        channel->receivePacket(data);
+    }
+}
+
+static QThread *sharedNetworkThread = 0;
+
+static void stopNetworkThread()
+{
+    sharedNetworkThread->quit();
+    sharedNetworkThread->wait();
+    delete sharedNetworkThread;
+    sharedNetworkThread = 0;
+}
+
+/* The network thread is started with the first connection that needs it,
+ * and stopped when the application exits. */
+QThread *ConnectionIO::networkThread()
+{
+    if (!sharedNetworkThread) {
+        sharedNetworkThread = new QThread;
+        sharedNetworkThread->setObjectName(QStringLiteral("network"));
+        sharedNetworkThread->start();
+        qAddPostRoutine(stopNetworkThread);
+    }
+    return sharedNetworkThread;
+}
+
+ConnectionIO::ConnectionIO(QTcpSocket *s, const QSharedPointer<IncomingPackets> &in)
+    : socket(s), incoming(in)
+{
+    socket->setParent(this);
+    socket->setReadBufferSize(MaxQueuedBytes);
+    connect(socket, &QIODevice::readyRead, this, &ConnectionIO::socketReadable);
+    connect(socket, &QAbstractSocket::disconnected, this, &ConnectionIO::disconnected);
+}
+
+void ConnectionIO::start()
+{
+    if (socket->state() != QAbstractSocket::ConnectedState) {
+        emit disconnected();
+        return;
+    }
+
+    socketReadable();
+}
+
+void ConnectionIO::write(const QByteArray &packet)
+{
+    if (socket->state() != QAbstractSocket::ConnectedState)
+        return;
+
+    if (socket->write(packet) != packet.size()) {
+        qDebug() << "Connection socket error" << socket->error() << "during write:" << socket->errorString();
+        socket->abort();
+    }
+}
+
+void ConnectionIO::disconnectFromHost()
+{
+    socket->disconnectFromHost();
+}
+
+void ConnectionIO::abort()
+{
+    socket->abort();
+}
+
+void ConnectionIO::resume()
+{
+    socketReadable();
+}
+
+void ConnectionIO::socketReadable()
+{
+    QList<QPair<int,QByteArray> > packets;
+    int packetsSize = 0;
+    int queuedSize;
+    {
+        QMutexLocker locker(&incoming->mutex);
+        queuedSize = incoming->size;
+    }
+
     qint64 available;
-    while ((available = socket->bytesAvailable()) >= PacketHeaderSize) {
-        uchar header[PacketHeaderSize];
+    while ((available = socket->bytesAvailable()) >= ConnectionPrivate::PacketHeaderSize) {
+        if (queuedSize + packetsSize >= MaxQueuedBytes) {
+            // Unread data stays in the socket's buffer, which is limited to
+            // the same size, so the peer is eventually held back by TCP
+            QMutexLocker locker(&incoming->mutex);
+            incoming->paused = true;
+            break;
+        }
+
+        uchar header[ConnectionPrivate::PacketHeaderSize];
         // Peek at the header first, to read the size of the packet and make sure
         // the entire thing is available within the buffer.
-        qint64 re = socket->peek(reinterpret_cast<char*>(header), PacketHeaderSize);
+        qint64 re = socket->peek(reinterpret_cast<char*>(header), ConnectionPrivate::PacketHeaderSize);
         if (re < 0) {
             qDebug() << "Connection socket error" << socket->error() << "during read:" << socket->errorString();
             socket->abort();
             return;
-        } else if (re < PacketHeaderSize) {
+        } else if (re < ConnectionPrivate::PacketHeaderSize) {
             BUG() << "Socket had" << available << "bytes available but peek only returned" << re;
             return;
         }
 
-        Q_STATIC_ASSERT(PacketHeaderSize == 4);
+        Q_STATIC_ASSERT(ConnectionPrivate::PacketHeaderSize == 4);
         quint16 packetSize = qFromBigEndian<quint16>(header);
         quint16 channelId = qFromBigEndian<quint16>(&header[2]);
 
-        if (packetSize < PacketHeaderSize) {
+        if (packetSize < ConnectionPrivate::PacketHeaderSize) {
             qWarning() << "Corrupted data from connection (packet size is too small); disconnecting";
             socket->abort();
             return;
@@ -347,8 +585,8 @@ void ConnectionPrivate::socketReadable()
             break;
 
         // Read header out of the buffer and discard
-        re = socket->read(reinterpret_cast<char*>(header), PacketHeaderSize);
-        if (re != PacketHeaderSize) {
+        re = socket->read(reinterpret_cast<char*>(header), ConnectionPrivate::PacketHeaderSize);
+        if (re != ConnectionPrivate::PacketHeaderSize) {
             if (re < 0) {
                 qDebug() << "Connection socket error" << socket->error() << "during read:" << socket->errorString();
             } else {
@@ -361,7 +599,7 @@ void ConnectionPrivate::socketReadable()
         }
 
         // Read data
-        QByteArray data(packetSize - PacketHeaderSize, 0);
+        QByteArray data(packetSize - ConnectionPrivate::PacketHeaderSize, 0);
         re = (data.size() == 0) ? 0 : socket->read(data.data(), data.size());
         if (re != data.size()) {
             if (re < 0) {
@@ -374,34 +612,24 @@ void ConnectionPrivate::socketReadable()
             return;
         }
 
-        Channel *channel = q->channel(channelId);
-        if (!channel) {
-            // XXX We should sanity-check and rate limit these responses better
-            if (data.isEmpty()) {
-                qDebug() << "Ignoring channel close message for non-existent channel" << channelId;
-            } else {
-                qDebug() << "Ignoring" << data.size() << "byte packet for non-existent channel" << channelId;
-                // Send channel close message
-                writePacket(channelId, QByteArray());
-            }
-            continue;
-        }
+        packetsSize += data.size();
+        packets.append(qMakePair(int(channelId), data));
+    }
 
-        if (channel->connection() != q) {
-            // If this fails, something is extremely broken. It may be dangerous to continue
-            // processing any data at all. Crash gracefully.
-            BUG() << "Channel" << channelId << "found on connection" << this << "but its connection is"
-                  << channel->connection();
-            qFatal("Connection mismatch while handling packet");
-            return;
-        }
+    if (packets.isEmpty())
+        return;
 
-        if (data.isEmpty()) {
-            channel->closeChannel();
-        } else {
-            channel->receivePacket(data);
-        }
+    bool notify = false;
+    {
+        QMutexLocker locker(&incoming->mutex);
+        incoming->packets.append(packets);
+        incoming->size += packetsSize;
+        if (!incoming->notified)
+            notify = incoming->notified = true;
     }
+
+    if (notify)
+        emit packetsAvailable();
 }
 
 bool ConnectionPrivate::writePacket(Channel *channel, const QByteArray &data)
@@ -440,6 +668,15 @@ bool ConnectionPrivate::writePacket(int channelId, const QByteArray &data)
     qToBigEndian(static_cast<quint16>(PacketHeaderSize + data.size()), header);
     qToBigEndian(static_cast<quint16>(channelId), &header[2]);
 
+    if (io) {
+        // Written as one buffer, so the network thread handles whole packets
+        QByteArray packet;
+        packet.reserve(PacketHeaderSize + data.size());
+        packet.append(reinterpret_cast<char*>(header), PacketHeaderSize);
+        packet.append(data);
+        return QMetaObject::invokeMethod(io, "write", Qt::QueuedConnection, Q_ARG(QByteArray, packet));
+    }
+
     qint64 re = socket->write(reinterpret_cast<char*>(header), PacketHeaderSize);
     if (re != PacketHeaderSize) {
         qDebug() << "Connection socket error" << socket->error() << "during write:" << socket->errorString();
@@ -479,7 +716,7 @@ int ConnectionPrivate::availableOutboundChannelId()
     if (channels.contains(nextOutboundChannelId)) {
         // Abort the connection if we still couldn't find an id, because it's probably a nasty bug
         BUG() << "Can't find an available outbound channel ID for connection; aborting connection";
-        socket->abort();
+        abortSocket();
         return -1;
     }
 
@@ -633,17 +870,34 @@ bool Connection::hasAuthenticated(AuthenticationType type) const
 
 bool Connection::hasAuthenticatedAs(AuthenticationType type, const QString &identity) const
 {
+    OnionAddress address = OnionAddress::fromString(identity);
+    if (address.isValid())
+        return hasAuthenticatedAs(type, address);
+
     auto it = d->authentication.find(type);
     if (!identity.isEmpty() && it != d->authentication.end())
         return *it == identity;
     return false;
 }
 
+bool Connection::hasAuthenticatedAs(AuthenticationType type, const OnionAddress &address) const
+{
+    auto it = d->authenticatedAddresses.find(type);
+    if (address.isValid() && it != d->authenticatedAddresses.end())
+        return *it == address;
+    return false;
+}
+
 QString Connection::authenticatedIdentity(AuthenticationType type) const
 {
     return d->authentication.value(type);
 }
 
+OnionAddress Connection::authenticatedAddress(AuthenticationType type) const
+{
+    return d->authenticatedAddresses.value(type);
+}
+
 void Connection::grantAuthentication(AuthenticationType type, const QString &identity)
 {
     if (hasAuthenticated(type)) {
@@ -654,6 +908,9 @@ void Connection::grantAuthentication(AuthenticationType type, const QString &ide
     qDebug() << "Granting" << type << "authentication as" << identity << "to connection";
 
     d->authentication.insert(type, identity);
+    OnionAddress address = OnionAddress::fromString(identity);
+    if (address.isValid())
+        d->authenticatedAddresses.insert(type, address);
     emit authenticated(type, identity);
 }
 
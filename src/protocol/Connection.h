@@ -36,6 +36,7 @@
 #include <QObject>
 #include <QHash>
 #include "Channel.h"
+#include "utils/OnionAddress.h"
 
 class QTcpSocket;
 
@@ -61,6 +62,10 @@ class ConnectionPrivate;
  * particular, channel instances will be deleted automatically after being
  * closed. Avoid storing pointers to channels, or use a safe pointer to do so.
  *
+ * Once version negotiation has finished, the socket is read and written on
+ * a shared network thread and must not be used directly. The Connection,
+ * its channels and all of its signals stay on the thread that created it.
+ *
  * The channel's functionality is controlled by authentication grants and by its
  * assigned purpose. The purpose declares the current use of the channel (e.g.
  * for a known contact or an incoming contact request). Higher level classes
@@ -145,7 +150,10 @@ public:
 
     bool hasAuthenticated(AuthenticationType type) const;
     bool hasAuthenticatedAs(AuthenticationType type, const QString &identity) const;
+    bool hasAuthenticatedAs(AuthenticationType type, const OnionAddress &address) const;
     QString authenticatedIdentity(AuthenticationType type) const;
+    /* Onion address of the authenticated identity, if it is one */
+    OnionAddress authenticatedAddress(AuthenticationType type) const;
     void grantAuthentication(AuthenticationType type, const QString &identity = QString());
 
 public slots:
@@ -36,11 +36,75 @@
 #include "Connection.h"
 #include <QMap>
 #include <QElapsedTimer>
+#include <QMutex>
+#include <QSharedPointer>
+#include <QPair>
 #include <cstdint>
 
+class QThread;
+
 namespace Protocol
 {
 
+/* Packets read by ConnectionIO that haven't been handled yet
+ *
+ * The network thread appends and the connection's thread takes, with the
+ * mutex held only to move packets in or out. 'notified' is set while a
+ * packetsAvailable notification is pending, so one notification covers
+ * any number of packets. Reading pauses while 'size' is over the limit.
+ */
+struct IncomingPackets
+{
+    QMutex mutex;
+    QList<QPair<int,QByteArray> > packets;
+    int size;
+    bool notified;
+    bool paused;
+
+    IncomingPackets() : size(0), notified(false), paused(false) { }
+};
+
+/* Socket I/O for a Connection, on the network thread
+ *
+ * After version negotiation, the socket is moved to a ConnectionIO on a
+ * shared network thread, which reads from it and splits the stream into
+ * packets. Handling those packets and all channel state stays on the
+ * connection's thread; writes are queued to ConnectionIO as complete
+ * packets. A slow GUI thread can't hold up reading from the socket, and
+ * a busy socket can't hold up the GUI thread.
+ */
+class ConnectionIO : public QObject
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(ConnectionIO)
+
+public:
+    // Bytes of unhandled packets before reading from the socket pauses
+    static const int MaxQueuedBytes = 1024 * 1024;
+
+    ConnectionIO(QTcpSocket *socket, const QSharedPointer<IncomingPackets> &incoming);
+
+    static QThread *networkThread();
+
+public slots:
+    void start();
+    void write(const QByteArray &packet);
+    void disconnectFromHost();
+    void abort();
+    void resume();
+
+signals:
+    void packetsAvailable();
+    void disconnected();
+
+private slots:
+    void socketReadable();
+
+private:
+    QTcpSocket *socket;
+    QSharedPointer<IncomingPackets> incoming;
+};
+
 class ConnectionPrivate : public QObject
 {
     Q_OBJECT
@@ -58,9 +122,16 @@ public:
     virtual ~ConnectionPrivate();
 
     Connection *q;
+    /* Socket until version negotiation finishes; it then belongs to io on
+     * the network thread, and is only used through queued calls */
     QTcpSocket *socket;
+    ConnectionIO *io;
+    QSharedPointer<IncomingPackets> incoming;
+    QString serverHostname;
+    bool ioConnected;
     QHash<int,Channel*> channels;
     QMap<Connection::AuthenticationType,QString> authentication;
+    QMap<Connection::AuthenticationType,OnionAddress> authenticatedAddresses;
     QElapsedTimer ageTimer;
     Connection::Direction direction;
     Connection::Purpose purpose;
@@ -80,14 +151,22 @@ public:
     bool writePacket(Channel *channel, const QByteArray &data);
     bool writePacket(int channelId, const QByteArray &data);
 
+    void abortSocket();
+
 public slots:
     void closeImmediately();
 
 private slots:
     void socketReadable();
     void socketDisconnected();
+    void ioDisconnected();
+    void packetsAvailable();
 
 private:
+    void moveToNetworkThread();
+    void handlePackets(bool limitTime);
+    void handlePacket(int channelId, const QByteArray &data);
+
     int nextOutboundChannelId;
 };
 
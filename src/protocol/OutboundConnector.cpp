@@ -33,9 +33,14 @@
 #include "OutboundConnector.h"
 #include "utils/Useful.h"
 #include "tor/TorSocket.h"
+#include "tor/TorControl.h"
+#include "tor/ConnectionTimings.h"
+#include "utils/OnionAddress.h"
+#include "utils/SecureRNG.h"
 #include "ControlChannel.h"
 #include "AuthHiddenServiceChannel.h"
 #include <QSharedPointer>
+#include <QElapsedTimer>
 
 using namespace Protocol;
 
@@ -58,6 +63,18 @@ public:
     QTimer errorRetryTimer;
     int errorRetryCount;
 
+    /* Hedged attempts
+     *
+     * When an attempt on socket takes longer than the hedge threshold of
+     * ConnectionTimings, hedgeSocket starts a second attempt with different
+     * SOCKS credentials, so Tor builds it on different circuits. Whichever
+     * connects first is used and the other is aborted.
+     */
+    Tor::TorSocket *hedgeSocket;
+    QTimer hedgeTimer;
+    QElapsedTimer attemptTimer;
+    QElapsedTimer hedgeAttemptTimer;
+
     OutboundConnectorPrivate(OutboundConnector *q)
         : QObject(q)
         , q(q)
@@ -65,15 +82,27 @@ public:
         , port(0)
         , status(OutboundConnector::Inactive)
         , errorRetryCount(0)
+        , hedgeSocket(0)
     {
         connect(&errorRetryTimer, &QTimer::timeout, this, &OutboundConnectorPrivate::retryAfterError);
+        hedgeTimer.setSingleShot(true);
+        connect(&hedgeTimer, &QTimer::timeout, this, &OutboundConnectorPrivate::startHedge);
     }
 
     void setStatus(OutboundConnector::Status status);
     void setError(const QString &errorMessage);
+    void setReady();
+    Tor::ConnectionTimings *timings() const { return torControl ? torControl->connectionTimings() : 0; }
+
+    void socketStateChanged(QAbstractSocket::SocketState state);
+    void abortHedge();
+
+    void recordConnectTime(qint64 msecs);
 
 public slots:
     void onConnected();
+    void startHedge();
+    void hedgeFailed();
     void startAuthentication();
     void abort();
     void retryAfterError();
@@ -132,7 +161,10 @@ bool OutboundConnector::connectToHost(const QString &hostname, quint16 port)
 
     d->socket = new Tor::TorSocket(this);
     connect(d->socket, &Tor::TorSocket::connected, d, &OutboundConnectorPrivate::onConnected);
+    connect(d->socket, &Tor::TorSocket::stateChanged, d, &OutboundConnectorPrivate::socketStateChanged);
     d->setStatus(Connecting);
+    if (d->timings())
+        d->timings()->start(OnionAddress::fromString(d->hostname));
     d->socket->connectToHost(d->hostname, d->port);
     return true;
 }
@@ -150,6 +182,9 @@ void OutboundConnector::abort()
 
 void OutboundConnectorPrivate::abort()
 {
+    if (timings() && status != OutboundConnector::Ready)
+        timings()->cancel(OnionAddress::fromString(hostname));
+
     if (connection) {
         connection->close();
         connection.clear();
@@ -160,6 +195,79 @@ void OutboundConnectorPrivate::abort()
         delete socket;
         socket = 0;
     }
+
+    abortHedge();
+    hedgeTimer.stop();
+    attemptTimer.invalidate();
+}
+
+void OutboundConnectorPrivate::abortHedge()
+{
+    if (hedgeSocket) {
+        hedgeSocket->disconnect(this);
+        hedgeSocket->abort();
+        hedgeSocket->deleteLater();
+        hedgeSocket = 0;
+    }
+}
+
+void OutboundConnectorPrivate::recordConnectTime(qint64 msecs)
+{
+    if (timings())
+        timings()->recordConnectTime(msecs);
+}
+
+void OutboundConnectorPrivate::socketStateChanged(QAbstractSocket::SocketState state)
+{
+    // TorSocket retries on its own; each attempt starts when the socket
+    // leaves UnconnectedState, and arms the hedge timer again.
+    if (state == QAbstractSocket::UnconnectedState) {
+        attemptTimer.invalidate();
+        hedgeTimer.stop();
+    } else if (!attemptTimer.isValid()) {
+        attemptTimer.start();
+        // Roughly one attempt in ten is hedged
+        if (!hedgeSocket && timings())
+            hedgeTimer.start(timings()->hedgeThreshold());
+    }
+}
+
+void OutboundConnectorPrivate::startHedge()
+{
+    if (!socket || hedgeSocket || status != OutboundConnector::Connecting)
+        return;
+
+    qDebug() << "Outbound connection to" << hostname << "has taken" << attemptTimer.elapsed()
+             << "ms; starting a parallel attempt";
+
+    hedgeSocket = new Tor::TorSocket(q);
+    hedgeSocket->setReconnectEnabled(false);
+    // Any credentials that differ from the first socket's isolate this stream
+    hedgeSocket->setSocksCredentials(QStringLiteral("hedge"), QString::fromLatin1(SecureRNG::randomPrintable(16)));
+    connect(hedgeSocket, &Tor::TorSocket::connected, this, &OutboundConnectorPrivate::onConnected);
+    connect(hedgeSocket, SIGNAL(error(QAbstractSocket::SocketError)), this, SLOT(hedgeFailed()));
+    hedgeAttemptTimer.start();
+    hedgeSocket->connectToHost(hostname, port);
+}
+
+void OutboundConnector::retryNow()
+{
+    if (d->status == Error && d->errorRetryTimer.isActive()) {
+        d->errorRetryTimer.stop();
+        d->retryAfterError();
+    } else if (d->status == Connecting && d->socket) {
+        d->socket->connectNow();
+    }
+}
+
+void OutboundConnector::retryLater(int seconds)
+{
+    if (d->status == Error && d->errorRetryTimer.isActive()) {
+        if (d->errorRetryTimer.remainingTime() < seconds * 1000)
+            d->errorRetryTimer.start(seconds * 1000);
+    } else if (d->status == Connecting && d->socket) {
+        d->socket->postponeAttempts(seconds);
+    }
 }
 
 OutboundConnector::Status OutboundConnector::status() const
@@ -222,6 +330,15 @@ void OutboundConnectorPrivate::setError(const QString &message)
     qDebug() << "Retrying outbound connection attempt in 60 seconds after an error";
 }
 
+void OutboundConnectorPrivate::setReady()
+{
+    if (timings())
+        timings()->finish(OnionAddress::fromString(hostname));
+
+    setStatus(OutboundConnector::Ready);
+    emit q->ready();
+}
+
 void OutboundConnectorPrivate::retryAfterError()
 {
     if (status != OutboundConnector::Error) {
@@ -238,6 +355,12 @@ void OutboundConnectorPrivate::retryAfterError()
     q->connectToHost(hostname, port);
 }
 
+void OutboundConnectorPrivate::hedgeFailed()
+{
+    qDebug() << "Parallel outbound connection attempt to" << hostname << "failed";
+    abortHedge();
+}
+
 void OutboundConnectorPrivate::onConnected()
 {
     if (!socket || status != OutboundConnector::Connecting) {
@@ -246,11 +369,36 @@ void OutboundConnectorPrivate::onConnected()
         return;
     }
 
+    Tor::TorSocket *connectedSocket = qobject_cast<Tor::TorSocket*>(sender());
+    if (connectedSocket && connectedSocket == hedgeSocket) {
+        qDebug() << "Parallel outbound connection attempt to" << hostname << "finished first";
+        recordConnectTime(hedgeAttemptTimer.elapsed());
+        socket->disconnect(this);
+        socket->setReconnectEnabled(false);
+        socket->abort();
+        socket->deleteLater();
+        socket = hedgeSocket;
+        hedgeSocket = 0;
+    } else {
+        if (attemptTimer.isValid())
+            recordConnectTime(attemptTimer.elapsed());
+        abortHedge();
+    }
+    socket->disconnect(this);
+    hedgeTimer.stop();
+    attemptTimer.invalidate();
+
+    if (timings())
+        timings()->mark(OnionAddress::fromString(hostname), Tor::ConnectionTimings::SocksConnected);
+
     connection = QSharedPointer<Connection>(new Connection(socket, Connection::ClientSide), &QObject::deleteLater);
 
-    // Socket is now owned by connection
+    // Socket is now owned by connection, which moves it to the network
+    // thread after the handshake; it no longer follows Tor's connectivity
     Q_ASSERT(socket->parent() == connection);
     socket->setReconnectEnabled(false);
+    if (torControl)
+        QObject::disconnect(torControl, 0, socket, 0);
     socket = 0;
 
     connect(connection.data(), &Connection::ready, this, &OutboundConnectorPrivate::startAuthentication);
@@ -274,8 +422,7 @@ void OutboundConnectorPrivate::startAuthentication()
 
     if (!authPrivateKey.isLoaded() || !authPrivateKey.isPrivate()) {
         qDebug() << "Skipping authentication for OutboundConnector without a private key";
-        setStatus(OutboundConnector::Ready);
-        emit q->ready();
+        setReady();
         return;
     }
 
@@ -283,8 +430,9 @@ void OutboundConnectorPrivate::startAuthentication()
     AuthHiddenServiceChannel *authChannel = new AuthHiddenServiceChannel(Channel::Outbound, connection.data());
     connect(authChannel, &AuthHiddenServiceChannel::authSuccessful, this,
         [this]() {
-            setStatus(OutboundConnector::Ready);
-            emit q->ready();
+            if (timings())
+                timings()->mark(OnionAddress::fromString(hostname), Tor::ConnectionTimings::Authenticated);
+            setReady();
         }
     );
     connect(authChannel, &AuthHiddenServiceChannel::authFailed, this,
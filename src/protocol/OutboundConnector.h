@@ -89,6 +89,12 @@ public:
 
 public slots:
     void abort();
+    /* Skip any wait before the next connection attempt, e.g. when the peer
+     * is known to have just become reachable. */
+    void retryNow();
+    /* Wait at least 'seconds' before the next connection attempt, e.g. when
+     * the peer is known to be unreachable. */
+    void retryLater(int seconds);
 
 signals:
     void ready();
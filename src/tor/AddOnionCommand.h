@@ -0,0 +1,84 @@
+/* Ricochet - https://ricochet.im/
+ * Copyright (C) 2014, John Brooks <john.brooks@dereferenced.net>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *    * Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following disclaimer
+ *      in the documentation and/or other materials provided with the
+ *      distribution.
+ *
+ *    * Neither the names of the copyright owners nor the names of its
+ *      contributors may be used to endorse or promote products derived from
+ *      this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef ADDONIONCOMMAND_H
+#define ADDONIONCOMMAND_H
+
+#include "TorControlCommand.h"
+
+namespace Tor
+{
+
+class HiddenService;
+
+/* Publishes an ephemeral onion service with ADD_ONION
+ *
+ * The service's private key is sent with the command, so Tor doesn't need a
+ * HiddenServiceDir and nothing is written to disk. Ephemeral services are
+ * removed when the control connection that created them is closed, and
+ * must be added again after reconnecting.
+ */
+class AddOnionCommand : public TorControlCommand
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(AddOnionCommand)
+
+    Q_PROPERTY(QString errorMessage READ errorMessage CONSTANT)
+    Q_PROPERTY(bool successful READ isSuccessful CONSTANT)
+
+public:
+    explicit AddOnionCommand(HiddenService *service);
+
+    QByteArray build();
+
+    QString errorMessage() const { return m_errorMessage; }
+    /* Service ID reported by Tor, without ".onion" */
+    QString serviceID() const { return m_serviceID; }
+    bool isSuccessful() const;
+
+signals:
+    void succeeded();
+    void failed(int code);
+
+protected:
+    HiddenService *m_service;
+    QString m_errorMessage;
+    QString m_serviceID;
+
+    virtual void onReply(int statusCode, const QByteArray &data);
+    virtual void onFinished(int statusCode);
+};
+
+}
+
+#endif // ADDONIONCOMMAND_H
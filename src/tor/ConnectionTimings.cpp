@@ -0,0 +1,164 @@
+/* Ricochet - https://ricochet.im/
+ * Copyright (C) 2014, John Brooks <john.brooks@dereferenced.net>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *    * Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following disclaimer
+ *      in the documentation and/or other materials provided with the
+ *      distribution.
+ *
+ *    * Neither the names of the copyright owners nor the names of its
+ *      contributors may be used to endorse or promote products derived from
+ *      this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "ConnectionTimings.h"
+#include "TorEvents.h"
+#include <QStringList>
+#include <QDebug>
+#include <algorithm>
+
+using namespace Tor;
+
+ConnectionTimings::ConnectionTimings(TorEvents *events, QObject *parent)
+    : QObject(parent)
+{
+    connect(events, &TorEvents::circuitEvent, this, &ConnectionTimings::circuitEvent);
+    connect(events, &TorEvents::streamEvent, this, &ConnectionTimings::streamEvent);
+    connect(events, &TorEvents::hsDescEvent, this, &ConnectionTimings::hsDescEvent);
+    events->enableEvents(TorEvents::CircuitEvents | TorEvents::StreamEvents | TorEvents::HsDescEvents);
+}
+
+QString ConnectionTimings::phaseName(Phase phase)
+{
+    switch (phase) {
+        case DescriptorRequested: return QStringLiteral("descriptorRequested");
+        case DescriptorReceived: return QStringLiteral("descriptorReceived");
+        case RendezvousCircuitBuilt: return QStringLiteral("rendezvousCircuitBuilt");
+        case RendezvousJoined: return QStringLiteral("rendezvousJoined");
+        case StreamSucceeded: return QStringLiteral("streamSucceeded");
+        case SocksConnected: return QStringLiteral("socksConnected");
+        case Authenticated: return QStringLiteral("authenticated");
+        case PhaseCount: break;
+    }
+    return QString();
+}
+
+void ConnectionTimings::start(const OnionAddress &address)
+{
+    if (!address.isValid() || m_attempts.contains(address))
+        return;
+
+    Attempt &attempt = m_attempts[address];
+    for (int i = 0; i < PhaseCount; i++)
+        attempt.elapsed[i] = -1;
+    attempt.clock.start();
+}
+
+void ConnectionTimings::mark(const OnionAddress &address, Phase phase)
+{
+    QHash<OnionAddress,Attempt>::Iterator it = m_attempts.find(address);
+    if (it == m_attempts.end() || it->elapsed[phase] >= 0)
+        return;
+
+    it->elapsed[phase] = it->clock.elapsed();
+}
+
+void ConnectionTimings::finish(const OnionAddress &address)
+{
+    QHash<OnionAddress,Attempt>::Iterator it = m_attempts.find(address);
+    if (it == m_attempts.end())
+        return;
+
+    QVariantMap result;
+    QStringList summary;
+    for (int i = 0; i < PhaseCount; i++) {
+        if (it->elapsed[i] < 0)
+            continue;
+        QString name = phaseName(Phase(i));
+        result.insert(name, it->elapsed[i]);
+        summary.append(QStringLiteral("%1 %2ms").arg(name).arg(it->elapsed[i]));
+    }
+    m_attempts.erase(it);
+
+    QString hostname = address.hostname();
+    m_results.insert(address, result);
+    qDebug() << "Connection timings for" << hostname << ":" << summary.join(QStringLiteral(", "));
+    emit finished(hostname, result);
+}
+
+void ConnectionTimings::cancel(const OnionAddress &address)
+{
+    m_attempts.remove(address);
+}
+
+QVariantMap ConnectionTimings::timings(const QString &hostname) const
+{
+    return m_results.value(OnionAddress::fromString(hostname));
+}
+
+static const int maxConnectTimeSamples = 20;
+
+void ConnectionTimings::recordConnectTime(qint64 msecs)
+{
+    m_connectTimes.append(int(msecs));
+    if (m_connectTimes.size() > maxConnectTimeSamples)
+        m_connectTimes.removeFirst();
+}
+
+/* The 90th percentile of recent connect times. Until there are enough
+ * samples, a fixed threshold is used. */
+int ConnectionTimings::hedgeThreshold() const
+{
+    if (m_connectTimes.size() < 5)
+        return 20 * 1000;
+
+    QList<int> sorted = m_connectTimes;
+    std::sort(sorted.begin(), sorted.end());
+    int p90 = sorted[qMin(sorted.size() - 1, sorted.size() * 9 / 10)];
+    return qBound(5 * 1000, p90, 60 * 1000);
+}
+
+void ConnectionTimings::hsDescEvent(const HsDescEvent &event)
+{
+    if (event.action == "REQUESTED")
+        mark(event.address, DescriptorRequested);
+    else if (event.action == "RECEIVED")
+        mark(event.address, DescriptorReceived);
+}
+
+void ConnectionTimings::circuitEvent(const CircuitEvent &event)
+{
+    if (!event.rendQuery.isValid() || event.purpose != "HS_CLIENT_REND")
+        return;
+
+    if (event.hsState == "HSCR_JOINED")
+        mark(event.rendQuery, RendezvousJoined);
+    else if (event.status == "BUILT")
+        mark(event.rendQuery, RendezvousCircuitBuilt);
+}
+
+void ConnectionTimings::streamEvent(const StreamEvent &event)
+{
+    if (event.status == "SUCCEEDED")
+        mark(event.target, StreamSucceeded);
+}
@@ -0,0 +1,123 @@
+/* Ricochet - https://ricochet.im/
+ * Copyright (C) 2014, John Brooks <john.brooks@dereferenced.net>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *    * Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following disclaimer
+ *      in the documentation and/or other materials provided with the
+ *      distribution.
+ *
+ *    * Neither the names of the copyright owners nor the names of its
+ *      contributors may be used to endorse or promote products derived from
+ *      this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef CONNECTIONTIMINGS_H
+#define CONNECTIONTIMINGS_H
+
+#include <QObject>
+#include <QHash>
+#include <QElapsedTimer>
+#include <QVariantMap>
+#include <QList>
+#include "utils/OnionAddress.h"
+
+namespace Tor
+{
+
+class TorEvents;
+struct CircuitEvent;
+struct StreamEvent;
+struct HsDescEvent;
+
+/* Measures where the time goes in outbound connections to onion services
+ *
+ * A connection attempt is started by OutboundConnector when it begins
+ * connecting to a peer. Control port events for the same onion address
+ * (the descriptor fetch, the rendezvous circuit, and the stream) mark
+ * the progress of each phase, and OutboundConnector marks the phases that
+ * only Ricochet sees. When the attempt finishes, the milliseconds from
+ * the start to each phase are logged and published with finished().
+ *
+ * Phases are recorded the first time they are reached; Tor retries
+ * failed circuits internally, so the later phases include those retries.
+ */
+class ConnectionTimings : public QObject
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(ConnectionTimings)
+
+public:
+    enum Phase {
+        DescriptorRequested,
+        DescriptorReceived,
+        RendezvousCircuitBuilt,
+        RendezvousJoined,
+        StreamSucceeded,
+        SocksConnected,
+        Authenticated,
+        PhaseCount
+    };
+
+    ConnectionTimings(TorEvents *events, QObject *parent = 0);
+
+    void start(const OnionAddress &address);
+    void mark(const OnionAddress &address, Phase phase);
+    /* Publish the timings of an attempt, and stop tracking it */
+    void finish(const OnionAddress &address);
+    /* Stop tracking an attempt without publishing anything */
+    void cancel(const OnionAddress &address);
+
+    /* Timings of the last finished attempt for a hostname, keyed by phase name */
+    Q_INVOKABLE QVariantMap timings(const QString &hostname) const;
+
+    /* Record how long a successful connection attempt took to connect */
+    void recordConnectTime(qint64 msecs);
+    /* Milliseconds after which an attempt is slower than roughly nine in
+     * ten recent successful attempts, and is worth hedging */
+    int hedgeThreshold() const;
+
+    static QString phaseName(Phase phase);
+
+signals:
+    void finished(const QString &hostname, const QVariantMap &timings);
+
+private slots:
+    void circuitEvent(const Tor::CircuitEvent &event);
+    void streamEvent(const Tor::StreamEvent &event);
+    void hsDescEvent(const Tor::HsDescEvent &event);
+
+private:
+    struct Attempt {
+        QElapsedTimer clock;
+        qint64 elapsed[PhaseCount];
+    };
+
+    QHash<OnionAddress,Attempt> m_attempts;
+    QHash<OnionAddress,QVariantMap> m_results;
+    /* Connect times of recent successful attempts, in milliseconds */
+    QList<int> m_connectTimes;
+};
+
+}
+
+#endif // CONNECTIONTIMINGS_H
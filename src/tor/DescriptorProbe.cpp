@@ -0,0 +1,146 @@
+/* Ricochet - https://ricochet.im/
+ * Copyright (C) 2014, John Brooks <john.brooks@dereferenced.net>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *    * Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following disclaimer
+ *      in the documentation and/or other materials provided with the
+ *      distribution.
+ *
+ *    * Neither the names of the copyright owners nor the names of its
+ *      contributors may be used to endorse or promote products derived from
+ *      this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "DescriptorProbe.h"
+#include "TorControl.h"
+#include "TorControlSocket.h"
+#include "TorControlCommand.h"
+#include "TorEvents.h"
+#include <QDebug>
+
+using namespace Tor;
+
+DescriptorProbe::DescriptorProbe(TorControl *control, TorControlSocket *socket, TorEvents *events, QObject *parent)
+    : QObject(parent), m_control(control), m_socket(socket), m_supported(true)
+{
+    connect(events, &TorEvents::hsDescEvent, this, &DescriptorProbe::hsDescEvent);
+    events->enableEvents(TorEvents::HsDescEvents);
+
+    connect(control, &TorControl::statusChanged, this, &DescriptorProbe::controlStatusChanged);
+
+    m_checkTimer.setInterval(1000);
+    connect(&m_checkTimer, &QTimer::timeout, this, &DescriptorProbe::checkProbes);
+}
+
+bool DescriptorProbe::probe(const OnionAddress &address)
+{
+    if (!m_supported || !address.isValid() || !m_control->isConnected())
+        return false;
+    if (m_probes.contains(address))
+        return true;
+
+    QHash<OnionAddress,ProbeResult>::ConstIterator last = m_results.find(address);
+    if (last != m_results.end() && last->finished.isValid() && !last->finished.hasExpired(MinProbeInterval))
+        return false;
+
+    Probe &probe = m_probes[address];
+    probe.started.start();
+    if (!m_checkTimer.isActive())
+        m_checkTimer.start();
+
+    TorControlCommand *command = new TorControlCommand;
+    connect(command, &TorControlCommand::finished, this,
+        [this, command, address]() {
+            if (command->statusCode() == 250)
+                return;
+
+            // 510 is "Unrecognized command", from versions of Tor without HSFETCH
+            if (command->statusCode() == 510 && m_supported) {
+                qDebug() << "torctrl: Tor does not support HSFETCH; descriptor probes are disabled";
+                m_supported = false;
+            }
+            finish(address, Unknown);
+        }
+    );
+    m_socket->sendCommand(command, "HSFETCH " + address.serviceID().toLatin1() + "\r\n");
+    return true;
+}
+
+void DescriptorProbe::hsDescEvent(const HsDescEvent &event)
+{
+    QHash<OnionAddress,Probe>::Iterator it = m_probes.find(event.address);
+    if (it == m_probes.end())
+        return;
+
+    if (event.action == "RECEIVED") {
+        finish(event.address, Published);
+    } else if (event.action == "REQUESTED") {
+        it->requested++;
+    } else if (event.action == "FAILED") {
+        it->failed++;
+        it->lastFailure.start();
+    }
+}
+
+void DescriptorProbe::checkProbes()
+{
+    QList<QPair<OnionAddress,Result> > finished;
+
+    for (QHash<OnionAddress,Probe>::ConstIterator it = m_probes.begin(); it != m_probes.end(); ++it) {
+        if (it->requested > 0 && it->failed >= it->requested && it->lastFailure.hasExpired(FailureSettleTime))
+            finished.append(qMakePair(it.key(), NotPublished));
+        else if (it->started.hasExpired(ProbeTimeout))
+            finished.append(qMakePair(it.key(), Unknown));
+    }
+
+    for (int i = 0; i < finished.size(); i++)
+        finish(finished[i].first, finished[i].second);
+}
+
+void DescriptorProbe::controlStatusChanged(int status)
+{
+    if (status == TorControl::Connected)
+        return;
+
+    // Commands and events are lost with the control connection
+    QList<OnionAddress> probes = m_probes.keys();
+    foreach (const OnionAddress &address, probes)
+        finish(address, Unknown);
+    m_supported = true;
+}
+
+void DescriptorProbe::finish(const OnionAddress &address, Result result)
+{
+    if (!m_probes.remove(address))
+        return;
+    if (m_probes.isEmpty())
+        m_checkTimer.stop();
+
+    ProbeResult &last = m_results[address];
+    last.result = result;
+    last.finished.start();
+
+    qDebug() << "Descriptor probe for" << address.hostname() << "finished:"
+             << (result == Published ? "published" : (result == NotPublished ? "not published" : "unknown"));
+    emit probeFinished(address, result);
+}
@@ -0,0 +1,131 @@
+/* Ricochet - https://ricochet.im/
+ * Copyright (C) 2014, John Brooks <john.brooks@dereferenced.net>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *    * Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following disclaimer
+ *      in the documentation and/or other materials provided with the
+ *      distribution.
+ *
+ *    * Neither the names of the copyright owners nor the names of its
+ *      contributors may be used to endorse or promote products derived from
+ *      this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef DESCRIPTORPROBE_H
+#define DESCRIPTORPROBE_H
+
+#include <QObject>
+#include <QHash>
+#include <QTimer>
+#include <QElapsedTimer>
+#include "utils/OnionAddress.h"
+
+namespace Tor
+{
+
+class TorControl;
+class TorControlSocket;
+class TorEvents;
+struct HsDescEvent;
+
+/* Checks whether onion services have a published descriptor
+ *
+ * A service is only reachable while it has a descriptor on the directory
+ * servers, and fetching that descriptor is much cheaper than a connection
+ * attempt: there's no rendezvous circuit and no SOCKS stream held open
+ * until it times out. probe() asks Tor to fetch the descriptor with
+ * HSFETCH, and follows HS_DESC events for the result. A fetched
+ * descriptor is also cached by Tor, so a connection made right after a
+ * successful probe skips that step.
+ *
+ * The result is Published when a descriptor is received, and
+ * NotPublished once every directory Tor asked has failed and no new
+ * request follows for a short while. Probes that see neither within
+ * ProbeTimeout end as Unknown. A service is not probed again within
+ * MinProbeInterval of its last result.
+ */
+class DescriptorProbe : public QObject
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(DescriptorProbe)
+
+public:
+    enum Result {
+        Unknown,
+        Published,
+        NotPublished
+    };
+
+    static const int MinProbeInterval = 60 * 1000;
+    static const int ProbeTimeout = 90 * 1000;
+    static const int FailureSettleTime = 5 * 1000;
+
+    DescriptorProbe(TorControl *control, TorControlSocket *socket, TorEvents *events, QObject *parent = 0);
+
+    /* False when Tor doesn't support HSFETCH (before 0.2.7) */
+    bool isSupported() const { return m_supported; }
+
+    /* Start a probe, unless one is running or finished recently. Returns
+     * false if it can't be probed right now. */
+    bool probe(const OnionAddress &address);
+    bool isProbing(const OnionAddress &address) const { return m_probes.contains(address); }
+    Result lastResult(const OnionAddress &address) const { return m_results.value(address).result; }
+
+signals:
+    void probeFinished(const OnionAddress &address, int result);
+
+private slots:
+    void hsDescEvent(const Tor::HsDescEvent &event);
+    void checkProbes();
+    void controlStatusChanged(int status);
+
+private:
+    struct Probe {
+        QElapsedTimer started;
+        QElapsedTimer lastFailure;
+        int requested;
+        int failed;
+
+        Probe() : requested(0), failed(0) { }
+    };
+
+    struct ProbeResult {
+        Result result;
+        QElapsedTimer finished;
+
+        ProbeResult() : result(Unknown) { }
+    };
+
+    TorControl *m_control;
+    TorControlSocket *m_socket;
+    QHash<OnionAddress,Probe> m_probes;
+    QHash<OnionAddress,ProbeResult> m_results;
+    QTimer m_checkTimer;
+    bool m_supported;
+
+    void finish(const OnionAddress &address, Result result);
+};
+
+}
+
+#endif // DESCRIPTORPROBE_H
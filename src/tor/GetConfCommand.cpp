@@ -38,6 +38,7 @@ using namespace Tor;
 
 GetConfCommand::GetConfCommand(Type t)
     : type(t)
+    , m_dataValue(0)
 {
 }
 
@@ -67,54 +68,61 @@ QByteArray GetConfCommand::build(const QList<QByteArray> &keys)
     return out;
 }
 
-void GetConfCommand::onReply(int statusCode, const QByteArray &data)
+void GetConfCommand::onReplyView(int statusCode, const QByteArray &data)
 {
-    TorControlCommand::onReply(statusCode, data);
+    emitReplyLine(statusCode, data);
     if (statusCode != 250)
         return;
 
     int kep = data.indexOf('=');
-    QString key = QString::fromLatin1(data.mid(0, kep));
+    QString key = QString::fromLatin1(data.constData(), kep >= 0 ? kep : data.size());
     QVariant value;
     if (kep >= 0)
         value = QString::fromLatin1(unquotedString(data.mid(kep + 1)));
 
     m_lastKey = key;
-    QVariantMap::iterator it = m_results.find(key);
-    if (it != m_results.end()) {
-        // Make a list of values
-        QVariantList results = it->toList();
-        if (results.isEmpty())
-            results.append(*it);
-        results.append(value);
-        *it = QVariant(results);
-    } else {
-        m_results.insert(key, value);
-    }
+    m_dataValue = 0;
+    m_pending[key].values.append(value);
 }
 
-void GetConfCommand::onDataLine(const QByteArray &data)
+void GetConfCommand::onDataLineView(const QByteArray &data)
 {
     if (m_lastKey.isEmpty()) {
         qWarning() << "torctrl: Unexpected data line in GetConf command";
         return;
     }
 
-    QVariantMap::iterator it = m_results.find(m_lastKey);
-    if (it != m_results.end()) {
-        QVariantList results = it->toList();
-        if (results.isEmpty() && !it->toByteArray().isEmpty())
-            results.append(*it);
-        results.append(data);
-        *it = QVariant(results);
-    } else {
-        m_results.insert(m_lastKey, QVariantList() << data);
+    if (!m_dataValue) {
+        m_dataValue = &m_pending[m_lastKey];
+        if (!m_dataValue->isData) {
+            // The value on the reply line is an empty placeholder for data replies
+            m_dataValue->isData = true;
+            if (m_dataValue->values.size() == 1 && m_dataValue->values.first().toByteArray().isEmpty())
+                m_dataValue->values.clear();
+        }
     }
+
+    m_dataValue->values.append(QByteArray(data.constData(), data.size()));
 }
 
 void GetConfCommand::onDataFinished()
 {
     m_lastKey.clear();
+    m_dataValue = 0;
+}
+
+void GetConfCommand::onFinished(int statusCode)
+{
+    for (QHash<QString,PendingValue>::ConstIterator it = m_pending.constBegin(); it != m_pending.constEnd(); ++it) {
+        if (it->isData || it->values.size() > 1)
+            m_results.insert(it.key(), it->values);
+        else
+            m_results.insert(it.key(), it->values.value(0));
+    }
+    m_pending.clear();
+    m_dataValue = 0;
+
+    TorControlCommand::onFinished(statusCode);
 }
 
 QVariant GetConfCommand::get(const QByteArray &key) const
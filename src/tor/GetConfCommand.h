@@ -35,6 +35,7 @@
 
 #include "TorControlCommand.h"
 #include <QList>
+#include <QHash>
 #include <QVariantMap>
 
 namespace Tor
@@ -63,13 +64,26 @@ public:
     QVariant get(const QByteArray &key) const;
 
 protected:
-    virtual void onReply(int statusCode, const QByteArray &data);
-    virtual void onDataLine(const QByteArray &data);
+    virtual void onReplyView(int statusCode, const QByteArray &data);
+    virtual void onDataLineView(const QByteArray &data);
     virtual void onDataFinished();
+    virtual void onFinished(int statusCode);
 
 private:
+    /* Values are collected in lists while the reply is streamed, and
+     * converted to m_results once when it has finished. */
+    struct PendingValue
+    {
+        QVariantList values;
+        bool isData;
+
+        PendingValue() : isData(false) { }
+    };
+
     QVariantMap m_results;
+    QHash<QString,PendingValue> m_pending;
     QString m_lastKey;
+    PendingValue *m_dataValue;
 };
 
 }
@@ -35,23 +35,29 @@
 #include "TorSocket.h"
 #include "utils/CryptoKey.h"
 #include <QDir>
-#include <QFile>
 #include <QTimer>
 #include <QDebug>
 
 using namespace Tor;
 
+HiddenService::HiddenService(const CryptoKey &privateKey, QObject *parent)
+    : QObject(parent), pStatus(NotCreated), pCryptoKey(privateKey)
+{
+    if (pCryptoKey.isPrivate()) {
+        pHostname = pCryptoKey.torServiceID() + QLatin1String(".onion");
+        pStatus = Offline;
+    } else {
+        qWarning() << "Hidden service created without a valid private key";
+    }
+}
+
 HiddenService::HiddenService(const QString &p, QObject *parent)
     : QObject(parent), dataPath(p), pStatus(NotCreated)
 {
-    /* Set the initial status and, if possible, load the hostname */
+    /* Set the initial status and, if possible, load the key and hostname */
     QDir dir(dataPath);
-    if (dir.exists(QLatin1String("hostname")) && dir.exists(QLatin1String("private_key")))
-    {
-        readHostname();
-        if (!pHostname.isEmpty())
-            pStatus = Offline;
-    }
+    if (dir.exists(QLatin1String("private_key")) && loadKeyFile())
+        pStatus = Offline;
 }
 
 void HiddenService::setStatus(Status newStatus)
@@ -75,66 +81,48 @@ void HiddenService::addTarget(const Target &target)
 
 void HiddenService::addTarget(quint16 servicePort, QHostAddress targetAddress, quint16 targetPort)
 {
-    Target t = { targetAddress, servicePort, targetPort };
+    Target t = { targetAddress, servicePort, targetPort, QString() };
     pTargets.append(t);
 }
 
-void HiddenService::readHostname()
+void HiddenService::addTarget(quint16 servicePort, const QString &targetPath)
 {
-    pHostname.clear();
-
-    QFile file(dataPath + QLatin1String("/hostname"));
-    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
-    {
-        qDebug() << "Failed to open hostname file for hidden service" << dataPath << "-" << file.errorString();
-        return;
-    }
-
-    QByteArray data;
-    data.resize(32);
-
-    int rd = file.readLine(data.data(), data.size());
-    if (rd < 0)
-    {
-        qDebug() << "Failed to read hostname file for hidden service" << dataPath << "-" << file.errorString();
-        return;
-    }
-
-    data.resize(rd);
+    Target t = { QHostAddress(), servicePort, 0, targetPath };
+    pTargets.append(t);
+}
 
-    int sep = data.lastIndexOf('.');
-    if (sep != 16 || data.mid(sep) != ".onion\n")
-    {
-        qDebug() << "Failed to read hostname file for hidden service" << dataPath << "- invalid contents";
-        return;
+bool HiddenService::loadKeyFile()
+{
+    if (!pCryptoKey.loadFromFile(dataPath + QLatin1String("/private_key"), CryptoKey::PrivateKey)) {
+        qWarning() << "Failed to load hidden service key from" << dataPath;
+        pHostname.clear();
+        return false;
     }
 
-    pHostname = QString::fromLatin1(data.constData(), sep) + QLatin1String(".onion");
+    pHostname = pCryptoKey.torServiceID() + QLatin1String(".onion");
     qDebug() << "Hidden service hostname is" << pHostname;
+    return true;
 }
 
-CryptoKey HiddenService::cryptoKey()
+void HiddenService::servicePublished()
 {
-    if (!pCryptoKey.isLoaded()) {
-        bool ok = pCryptoKey.loadFromFile(dataPath + QLatin1String("/private_key"), CryptoKey::PrivateKey);
-        if (!ok)
-            qWarning() << "Failed to load hidden service key";
+    // Services published with HiddenServiceDir may have had their key created by Tor
+    if (!pCryptoKey.isLoaded() && (dataPath.isEmpty() || !loadKeyFile()))
+    {
+        qDebug() << "Failed to load hidden service key after publishing";
+        return;
     }
 
-    return pCryptoKey;
+    qDebug() << "Hidden service published successfully; waiting for its descriptor to be uploaded";
+    setStatus(Publishing);
 }
 
-void HiddenService::servicePublished()
+void HiddenService::descriptorUploaded()
 {
-    readHostname();
-
-    if (pHostname.isEmpty())
-    {
-        qDebug() << "Failed to read hidden service hostname";
+    if (pStatus != Publishing)
         return;
-    }
 
-    qDebug() << "Hidden service published successfully";
+    qDebug() << "Hidden service descriptor uploaded for" << pHostname;
     setStatus(Online);
 }
 
@@ -55,27 +55,39 @@ public:
     {
         QHostAddress targetAddress;
         quint16 servicePort, targetPort;
+        /* Unix socket to forward to, instead of targetAddress and targetPort */
+        QString targetPath;
     };
 
     enum Status
     {
         NotCreated = -1, /* Service has not been created yet */
         Offline = 0, /* Data exists, but service is not published */
-        Online /* Published */
+        Publishing, /* Configured in Tor, but no descriptor has been uploaded yet */
+        Online /* Published, and reachable by clients */
     };
 
+    /* Directory of Tor's key files for this service, or empty for services
+     * whose key is only held in memory */
     const QString dataPath;
 
+    /* Service with a private key held in memory, published as an ephemeral
+     * service with ADD_ONION. Nothing is written to disk. */
+    HiddenService(const CryptoKey &privateKey, QObject *parent = 0);
+    /* Service using the private_key file in dataPath, as created by Tor for
+     * a HiddenServiceDir. The key is read once and also published with
+     * ADD_ONION, unless Tor is too old to support it. */
     HiddenService(const QString &dataPath, QObject *parent = 0);
 
     Status status() const { return pStatus; }
 
     const QString &hostname() const { return pHostname; }
-    CryptoKey cryptoKey();
+    CryptoKey cryptoKey() const { return pCryptoKey; }
 
     const QList<Target> &targets() const { return pTargets; }
     void addTarget(const Target &target);
     void addTarget(quint16 servicePort, QHostAddress targetAddress, quint16 targetPort);
+    void addTarget(quint16 servicePort, const QString &targetPath);
 
 signals:
     void statusChanged(int newStatus, int oldStatus);
@@ -83,6 +95,7 @@ signals:
 
 private slots:
     void servicePublished();
+    void descriptorUploaded();
 
 private:
     QList<Target> pTargets;
@@ -91,7 +104,7 @@ private:
     CryptoKey pCryptoKey;
 
     void setStatus(Status newStatus);
-    void readHostname();
+    bool loadKeyFile();
 };
 
 }
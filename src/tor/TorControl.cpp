@@ -37,6 +37,10 @@
 #include "AuthenticateCommand.h"
 #include "SetConfCommand.h"
 #include "GetConfCommand.h"
+#include "AddOnionCommand.h"
+#include "TorEvents.h"
+#include "ConnectionTimings.h"
+#include "DescriptorProbe.h"
 #include "utils/StringUtil.h"
 #include "utils/Settings.h"
 #include "utils/PendingOperation.h"
@@ -45,7 +49,9 @@
 #include <QNetworkProxy>
 #include <QQmlEngine>
 #include <QTimer>
+#include <QPointer>
 #include <QSaveFile>
+#include <QElapsedTimer>
 #include <QDebug>
 
 Tor::TorControl *torControl = 0;
@@ -54,6 +60,26 @@ using namespace Tor;
 
 namespace Tor {
 
+/* Forwards the lines of a subscribed event to TorEvents */
+class EventCommand : public TorControlCommand
+{
+public:
+    explicit EventCommand(TorEvents *events)
+        : events(events)
+    {
+    }
+
+protected:
+    virtual void onReply(int statusCode, const QByteArray &data)
+    {
+        Q_UNUSED(statusCode);
+        events->handleEvent(data);
+    }
+
+private:
+    TorEvents *events;
+};
+
 class TorControlPrivate : public QObject
 {
     Q_OBJECT
@@ -63,15 +89,40 @@ public:
 
     TorControlSocket *socket;
     QHostAddress torAddress;
+    QString torSocketPath;
     QString errorMessage;
     QString torVersion;
     QByteArray authPassword;
     QHostAddress socksAddress;
+    QString socksSocketPath;
     QList<HiddenService*> services;
     quint16 controlPort, socksPort;
     TorControl::Status status;
     TorControl::TorStatus torStatus;
     QVariantMap bootstrapStatus;
+    /* Milliseconds from connect() to the first report of each bootstrap phase */
+    QVariantMap bootstrapTimings;
+    QElapsedTimer bootstrapClock;
+    TorEvents *events;
+    ConnectionTimings *connectionTimings;
+    DescriptorProbe *descriptorProbe;
+    /* Set when Tor rejected ADD_ONION, to publish with HiddenServiceDir instead */
+    bool addOnionUnsupported;
+    /* Services that ADD_ONION rejected because a HiddenServiceDir in torrc
+     * already uses their key, as saved by versions before 1.0.4. These are
+     * published with HiddenServiceDir until the next connection. */
+    QList<HiddenService*> directoryServices;
+    /* Services published with ADD_ONION that haven't uploaded a descriptor
+     * yet. Outbound connections wait for these, because peers can't connect
+     * back or verify us until the service is reachable. */
+    QList<HiddenService*> awaitingUpload;
+    /* Fallback timers for services published on this control connection,
+     * to stop waiting for an upload that's never reported */
+    QHash<HiddenService*,QPointer<QTimer> > uploadTimeouts;
+    /* Services by the HSDir and descriptor ID of their UPLOAD events, for
+     * matching UPLOADED events that don't include the address */
+    QHash<QByteArray,HiddenService*> uploadsInProgress;
+    bool connectivity;
 
     TorControlPrivate(TorControl *parent);
 
@@ -80,8 +131,14 @@ public:
 
     void getTorInfo();
     void publishServices();
+    void publishEphemeralService(HiddenService *service, bool holdConnectivity = true);
+    void publishServiceDirectories();
+    void finishUpload(HiddenService *service);
+    void cancelUploadTimeout(HiddenService *service);
+    void updateConnectivity();
 
 public slots:
+    void subscribeEvents();
     void socketConnected();
     void socketDisconnected();
     void socketError();
@@ -93,6 +150,7 @@ public slots:
 
     void statusEvent(int code, const QByteArray &data);
     void updateBootstrap(const QList<QByteArray> &data);
+    void hsDescEvent(const Tor::HsDescEvent &event);
 };
 
 }
@@ -104,13 +162,21 @@ TorControl::TorControl(QObject *parent)
 
 TorControlPrivate::TorControlPrivate(TorControl *parent)
     : QObject(parent), q(parent), controlPort(0), socksPort(0),
-      status(TorControl::NotConnected), torStatus(TorControl::TorUnknown)
+      status(TorControl::NotConnected), torStatus(TorControl::TorUnknown),
+      addOnionUnsupported(false), connectivity(false)
 {
     socket = new TorControlSocket(this);
     QObject::connect(socket, SIGNAL(connected()), this, SLOT(socketConnected()));
     QObject::connect(socket, SIGNAL(disconnected()), this, SLOT(socketDisconnected()));
     QObject::connect(socket, SIGNAL(error(QAbstractSocket::SocketError)), this, SLOT(socketError()));
     QObject::connect(socket, SIGNAL(error(QString)), this, SLOT(setError(QString)));
+
+    events = new TorEvents(this);
+    connectionTimings = new ConnectionTimings(events, this);
+    descriptorProbe = new DescriptorProbe(q, socket, events, this);
+    QObject::connect(events, &TorEvents::hsDescEvent, this, &TorControlPrivate::hsDescEvent);
+    events->enableEvents(TorEvents::HsDescEvents);
+    QObject::connect(events, &TorEvents::enabledEventsChanged, this, &TorControlPrivate::subscribeEvents);
 }
 
 QNetworkProxy TorControl::connectionProxy()
@@ -145,9 +211,9 @@ void TorControlPrivate::setTorStatus(TorControl::TorStatus n)
     TorControl::TorStatus old = torStatus;
     torStatus = n;
     emit q->torStatusChanged(torStatus, old);
-    emit q->connectivityChanged();
+    updateConnectivity();
 
-    if (torStatus == TorControl::TorReady && socksAddress.isNull()) {
+    if (torStatus == TorControl::TorReady && socksAddress.isNull() && socksSocketPath.isEmpty()) {
         // Request info again to read the SOCKS port
         getTorInfo();
     }
@@ -187,7 +253,41 @@ QString TorControl::errorMessage() const
 
 bool TorControl::hasConnectivity() const
 {
-    return torStatus() == TorReady && !d->socksAddress.isNull();
+    if (torStatus() != TorReady || (d->socksAddress.isNull() && d->socksSocketPath.isEmpty()))
+        return false;
+
+    // Circuits can be established well before Tor has finished bootstrapping,
+    // and connections made in that window mostly fail and back off
+    if (d->bootstrapStatus.value(QStringLiteral("progress")).toInt() < 100)
+        return false;
+
+    return d->awaitingUpload.isEmpty();
+}
+
+void TorControlPrivate::updateConnectivity()
+{
+    bool value = q->hasConnectivity();
+    if (value == connectivity)
+        return;
+
+    connectivity = value;
+    qDebug() << "torctrl: Connectivity is" << (connectivity ? "available" : "not available");
+    emit q->connectivityChanged();
+}
+
+TorEvents *TorControl::events() const
+{
+    return d->events;
+}
+
+ConnectionTimings *TorControl::connectionTimings() const
+{
+    return d->connectionTimings;
+}
+
+DescriptorProbe *TorControl::descriptorProbe() const
+{
+    return d->descriptorProbe;
 }
 
 QHostAddress TorControl::socksAddress() const
@@ -200,6 +300,11 @@ quint16 TorControl::socksPort() const
     return d->socksPort;
 }
 
+QString TorControl::socksSocketPath() const
+{
+    return d->socksSocketPath;
+}
+
 QList<HiddenService*> TorControl::hiddenServices() const
 {
     return d->services;
@@ -225,7 +330,10 @@ void TorControl::connect(const QHostAddress &address, quint16 port)
 
     d->torAddress = address;
     d->controlPort = port;
+    d->torSocketPath.clear();
     d->setTorStatus(TorUnknown);
+    d->bootstrapTimings.clear();
+    d->bootstrapClock.start();
 
     bool b = d->socket->blockSignals(true);
     d->socket->abort();
@@ -235,10 +343,42 @@ void TorControl::connect(const QHostAddress &address, quint16 port)
     d->socket->connectToHost(address, port);
 }
 
+void TorControl::connect(const QString &socketPath)
+{
+    if (status() > Connecting)
+    {
+        qDebug() << "Ignoring TorControl::connect due to existing connection";
+        return;
+    }
+
+    d->torAddress.clear();
+    d->controlPort = 0;
+    d->torSocketPath = socketPath;
+    d->setTorStatus(TorUnknown);
+    d->bootstrapTimings.clear();
+    d->bootstrapClock.start();
+
+    bool b = d->socket->blockSignals(true);
+    d->socket->abort();
+    d->socket->blockSignals(b);
+
+    d->setStatus(Connecting);
+    d->socket->connectToPath(socketPath);
+}
+
 void TorControl::reconnect()
 {
-    Q_ASSERT(!d->torAddress.isNull() && d->controlPort);
-    if (d->torAddress.isNull() || !d->controlPort || status() >= Connecting)
+    Q_ASSERT(!d->torSocketPath.isEmpty() || (!d->torAddress.isNull() && d->controlPort));
+    if (status() >= Connecting)
+        return;
+
+    if (!d->torSocketPath.isEmpty()) {
+        d->setStatus(Connecting);
+        d->socket->connectToPath(d->torSocketPath);
+        return;
+    }
+
+    if (d->torAddress.isNull() || !d->controlPort)
         return;
 
     d->setStatus(Connecting);
@@ -266,13 +406,29 @@ void TorControlPrivate::authenticateReply()
     TorControlCommand *clientEvents = new TorControlCommand;
     connect(clientEvents, &TorControlCommand::replyLine, this, &TorControlPrivate::statusEvent);
     socket->registerEvent("STATUS_CLIENT", clientEvents);
+    subscribeEvents();
 
     getTorInfo();
     publishServices();
+}
+
+void TorControlPrivate::subscribeEvents()
+{
+    if (!q->isConnected())
+        return;
 
-    // XXX Fix old configurations that would store unwanted options in torrc.
-    // This can be removed some suitable amount of time after 1.0.4.
-    q->saveConfiguration();
+    static const TorEvents::EventType types[] = {
+        TorEvents::CircuitEvents,
+        TorEvents::StreamEvents,
+        TorEvents::HsDescEvents,
+        TorEvents::BandwidthEvents
+    };
+
+    for (unsigned i = 0; i < sizeof(types) / sizeof(*types); i++) {
+        QByteArray name = TorEvents::eventName(types[i]);
+        if (events->enabledEvents().testFlag(types[i]) && !socket->isEventRegistered(name))
+            socket->registerEvent(name, new EventCommand(events));
+    }
 }
 
 void TorControlPrivate::socketConnected()
@@ -292,9 +448,23 @@ void TorControlPrivate::socketDisconnected()
     /* Clear some internal state */
     torVersion.clear();
     socksAddress.clear();
+    socksSocketPath.clear();
     socksPort = 0;
+    addOnionUnsupported = false;
+    directoryServices.clear();
+    awaitingUpload.clear();
+    uploadsInProgress.clear();
+    foreach (HiddenService *service, uploadTimeouts.keys())
+        cancelUploadTimeout(service);
     setTorStatus(TorControl::TorUnknown);
 
+    /* Ephemeral services are removed by Tor with the control connection, and
+     * all services are published again after reconnecting */
+    foreach (HiddenService *service, services) {
+        if (service->status() == HiddenService::Online || service->status() == HiddenService::Publishing)
+            service->setStatus(HiddenService::Offline);
+    }
+
     /* This emits the disconnected() signal as well */
     setStatus(TorControl::NotConnected);
 }
@@ -402,7 +572,7 @@ void TorControlPrivate::getTorInfo()
         qDebug() << "torctrl: Using manually specified SOCKS connection settings";
         socksAddress = forceAddress;
         socksPort = port;
-        emit q->connectivityChanged();
+        updateConnectivity();
     } else
         keys << QByteArray("net/listeners/socks");
 
@@ -418,6 +588,12 @@ void TorControlPrivate::getTorInfoReply()
     QList<QByteArray> listenAddresses = splitQuotedStrings(command->get(QByteArray("net/listeners/socks")).toString().toLatin1(), ' ');
     for (QList<QByteArray>::Iterator it = listenAddresses.begin(); it != listenAddresses.end(); ++it) {
         QByteArray value = unquotedString(*it);
+        if (value.startsWith("unix:")) {
+            if (socksSocketPath.isEmpty())
+                socksSocketPath = QFile::decodeName(value.mid(5));
+            continue;
+        }
+
         int sepp = value.indexOf(':');
         QHostAddress address(QString::fromLatin1(value.mid(0, sepp)));
         quint16 port = (quint16)value.mid(sepp+1).toUInt();
@@ -436,9 +612,12 @@ void TorControlPrivate::getTorInfoReply()
     /* It is not immediately an error to have no SOCKS address; when DisableNetwork is set there won't be a
      * listener yet. To handle that situation, we'll try to read the socks address again when TorReady state
      * is reached. */
-    if (!socksAddress.isNull()) {
+    if (!socksSocketPath.isEmpty()) {
+        qDebug() << "torctrl: SOCKS socket is" << socksSocketPath;
+        updateConnectivity();
+    } else if (!socksAddress.isNull()) {
         qDebug().nospace() << "torctrl: SOCKS address is " << socksAddress.toString() << ":" << socksPort;
-        emit q->connectivityChanged();
+        updateConnectivity();
     }
 
     if (command->get(QByteArray("status/circuit-established")).toInt() == 1) {
@@ -459,6 +638,24 @@ void TorControl::addHiddenService(HiddenService *service)
         return;
 
     d->services.append(service);
+
+    // Services added after connecting (e.g. a new identity) are published
+    // right away, instead of on the next connection
+    if (!isConnected())
+        return;
+
+    SettingsObject settings(QStringLiteral("tor"));
+    if (settings.read("neverPublishServices").toBool()) {
+        service->servicePublished();
+        service->descriptorUploaded();
+    } else if (d->addOnionUnsupported) {
+        // SETCONF replaces the whole list of HiddenServiceDir
+        d->publishServiceDirectories();
+    } else {
+        // Other services are already reachable; don't hold their connections
+        // back while this one uploads its descriptor
+        d->publishEphemeralService(service, false);
+    }
 }
 
 void TorControlPrivate::publishServices()
@@ -473,18 +670,124 @@ void TorControlPrivate::publishServices()
         qDebug() << "torctrl: Skipping service publication because neverPublishService is enabled";
 
         /* Call servicePublished under the assumption that they're published externally. */
-        for (QList<HiddenService*>::Iterator it = services.begin(); it != services.end(); ++it)
+        for (QList<HiddenService*>::Iterator it = services.begin(); it != services.end(); ++it) {
             (*it)->servicePublished();
+            (*it)->descriptorUploaded();
+        }
+
+        return;
+    }
+
+    if (addOnionUnsupported) {
+        publishServiceDirectories();
+        return;
+    }
 
+    foreach (HiddenService *service, services)
+        publishEphemeralService(service);
+}
+
+void TorControlPrivate::publishEphemeralService(HiddenService *service, bool holdConnectivity)
+{
+    if (!service->cryptoKey().isPrivate()) {
+        qWarning() << "torctrl: Cannot publish hidden service without a private key";
         return;
     }
 
+    qDebug() << "torctrl: Publishing ephemeral hidden service" << service->hostname();
+
+    if (holdConnectivity && !awaitingUpload.contains(service)) {
+        awaitingUpload.append(service);
+        updateConnectivity();
+    }
+
+    AddOnionCommand *command = new AddOnionCommand(service);
+    QObject::connect(command, &AddOnionCommand::succeeded, service,
+        [this, command, service]() {
+            if (command->serviceID() + QLatin1String(".onion") != service->hostname()) {
+                qWarning() << "torctrl: Tor published" << command->serviceID() << "instead of"
+                           << service->hostname();
+                finishUpload(service);
+                return;
+            }
+            service->servicePublished();
+
+            /* Don't hold outbound connections forever if the upload is never
+             * reported; Tor keeps retrying it in the background. */
+            cancelUploadTimeout(service);
+            QTimer *uploadTimer = new QTimer(service);
+            uploadTimer->setSingleShot(true);
+            QObject::connect(uploadTimer, &QTimer::timeout, service,
+                [this, service]() {
+                    cancelUploadTimeout(service);
+                    if (service->status() != HiddenService::Publishing)
+                        return;
+                    qWarning() << "torctrl: No descriptor upload reported for" << service->hostname()
+                               << "after 180 seconds; no longer waiting for it";
+                    service->descriptorUploaded();
+                    finishUpload(service);
+                }
+            );
+            uploadTimeouts.insert(service, uploadTimer);
+            uploadTimer->start(180 * 1000);
+        }
+    );
+    QObject::connect(command, &AddOnionCommand::failed, this,
+        [this, command, service](int code) {
+            // 510 is "Unrecognized command", from versions of Tor before 0.2.7
+            if (code == 510 && !addOnionUnsupported) {
+                qDebug() << "torctrl: Tor does not support ADD_ONION; using HiddenServiceDir instead";
+                addOnionUnsupported = true;
+                publishServiceDirectories();
+            } else if (code == 550 && !service->dataPath.isEmpty() && !directoryServices.contains(service)) {
+                /* 550 is "Onion address collision". Older versions saved their
+                 * HiddenServiceDir in torrc, and Tor loaded it again at startup;
+                 * its targets may be stale. Replace it with the current
+                 * configuration, and remove it from torrc for next time. */
+                qDebug() << "torctrl: Hidden service" << service->hostname()
+                         << "is configured in torrc; using HiddenServiceDir instead";
+                bool saveTorrc = directoryServices.isEmpty();
+                directoryServices.append(service);
+                finishUpload(service);
+                publishServiceDirectories();
+                if (saveTorrc)
+                    q->saveConfiguration();
+            } else if (code != 510) {
+                qWarning() << "torctrl: Publishing hidden service failed:" << command->errorMessage();
+                finishUpload(service);
+            }
+        }
+    );
+
+    socket->sendCommand(command, command->build());
+}
+
+/* Publish services through the HiddenServiceDir configuration, for versions of
+ * Tor without ADD_ONION and for services in directoryServices. Only services
+ * with a data directory can be published. */
+void TorControlPrivate::publishServiceDirectories()
+{
+    /* These versions of Tor don't report descriptor uploads, so services
+     * are considered online as soon as they're configured. */
+    if (addOnionUnsupported) {
+        awaitingUpload.clear();
+        updateConnectivity();
+    }
+
     SetConfCommand *command = new SetConfCommand;
     QList<QPair<QByteArray,QByteArray> > torConfig;
 
     for (QList<HiddenService*>::Iterator it = services.begin(); it != services.end(); ++it)
     {
         HiddenService *service = *it;
+        if (!addOnionUnsupported && !directoryServices.contains(service))
+            continue;
+        if (service->dataPath.isEmpty()) {
+            qWarning() << "torctrl: Hidden service" << service->hostname()
+                       << "cannot be published by this version of Tor, which doesn't support ADD_ONION";
+            continue;
+        }
+
         QDir dir(service->dataPath);
 
         qDebug() << "torctrl: Configuring hidden service at" << service->dataPath;
@@ -494,13 +797,28 @@ void TorControlPrivate::publishServices()
         const QList<HiddenService::Target> &targets = service->targets();
         for (QList<HiddenService::Target>::ConstIterator tit = targets.begin(); tit != targets.end(); ++tit)
         {
-            QString target = QString::fromLatin1("%1 %2:%3").arg(tit->servicePort)
-                             .arg(tit->targetAddress.toString())
-                             .arg(tit->targetPort);
-            torConfig.append(qMakePair(QByteArray("HiddenServicePort"), target.toLatin1()));
+            QByteArray target;
+            if (!tit->targetPath.isEmpty()) {
+                target = QByteArray::number(tit->servicePort) + " unix:" + QFile::encodeName(tit->targetPath);
+            } else {
+                target = QString::fromLatin1("%1 %2:%3").arg(tit->servicePort)
+                         .arg(tit->targetAddress.toString())
+                         .arg(tit->targetPort).toLatin1();
+            }
+            torConfig.append(qMakePair(QByteArray("HiddenServicePort"), target));
         }
 
-        QObject::connect(command, &SetConfCommand::setConfSucceeded, service, &HiddenService::servicePublished);
+        QObject::connect(command, &SetConfCommand::setConfSucceeded, service,
+            [service]() {
+                service->servicePublished();
+                service->descriptorUploaded();
+            }
+        );
+    }
+
+    if (torConfig.isEmpty()) {
+        delete command;
+        return;
     }
 
     socket->sendCommand(command, command->build(torConfig));
@@ -555,8 +873,85 @@ void TorControlPrivate::updateBootstrap(const QList<QByteArray> &data)
         bootstrapStatus[key.toLower()] = value;
     }
 
+    QString tag = bootstrapStatus.value(QStringLiteral("tag")).toString();
+    if (!tag.isEmpty() && !bootstrapTimings.contains(tag) && bootstrapClock.isValid())
+        bootstrapTimings.insert(tag, bootstrapClock.elapsed());
+    bootstrapStatus[QStringLiteral("timings")] = bootstrapTimings;
+
     qDebug() << bootstrapStatus;
     emit q->bootstrapStatusChanged();
+    updateConnectivity();
+}
+
+void TorControlPrivate::hsDescEvent(const HsDescEvent &event)
+{
+    if (event.action != "UPLOAD" && event.action != "UPLOADED")
+        return;
+
+    HiddenService *service = 0;
+    QList<HiddenService*> publishing;
+    foreach (HiddenService *s, services) {
+        if (s->status() != HiddenService::Publishing)
+            continue;
+        if (OnionAddress::fromString(s->hostname()) == event.address) {
+            service = s;
+            break;
+        }
+        publishing.append(s);
+    }
+
+    if (event.action == "UPLOAD") {
+        if (service) {
+            uploadsInProgress.insert(event.hsDir, service);
+            if (!event.descriptorId.isEmpty())
+                uploadsInProgress.insert(event.descriptorId, service);
+        }
+        return;
+    }
+
+    /* Some versions of Tor report the address of uploaded descriptors as
+     * UNKNOWN. Match those to the service that started an upload with the same
+     * descriptor ID or to the same HSDir. Failing that, it goes to the first
+     * service still waiting; services are published in order, and each
+     * uploads to several HSDirs, so every one is released soon after. */
+    if (!service && !event.address.isValid()) {
+        HiddenService *match = uploadsInProgress.value(event.descriptorId);
+        if (!match)
+            match = uploadsInProgress.value(event.hsDir);
+        if (match && publishing.contains(match))
+            service = match;
+        else if (!publishing.isEmpty())
+            service = publishing.first();
+    }
+
+    if (!service)
+        return;
+
+    qDebug() << "torctrl: Descriptor for" << service->hostname() << "was uploaded to" << event.hsDir;
+    service->descriptorUploaded();
+    finishUpload(service);
+}
+
+void TorControlPrivate::finishUpload(HiddenService *service)
+{
+    cancelUploadTimeout(service);
+    for (QHash<QByteArray,HiddenService*>::iterator it = uploadsInProgress.begin(); it != uploadsInProgress.end(); ) {
+        if (*it == service)
+            it = uploadsInProgress.erase(it);
+        else
+            it++;
+    }
+    if (awaitingUpload.removeOne(service))
+        updateConnectivity();
+}
+
+void TorControlPrivate::cancelUploadTimeout(HiddenService *service)
+{
+    QPointer<QTimer> timer = uploadTimeouts.take(service);
+    if (timer) {
+        timer->stop();
+        timer->deleteLater();
+    }
 }
 
 QObject *TorControl::getConfiguration(const QString &options)
@@ -632,6 +1027,9 @@ private slots:
             "DataDirectory",
             "HiddenServiceDir",
             "HiddenServicePort",
+            "AvoidDiskWrites",
+            "ControlPort unix:",
+            "SocksPort unix:",
             0
         };
 
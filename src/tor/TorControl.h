@@ -43,6 +43,9 @@ namespace Tor
 {
 
 class HiddenService;
+class TorEvents;
+class ConnectionTimings;
+class DescriptorProbe;
 class TorControlPrivate;
 
 class TorControl : public QObject
@@ -54,7 +57,8 @@ class TorControl : public QObject
     Q_PROPERTY(Status status READ status NOTIFY statusChanged)
     // Status of Tor (and whether it believes it can connect)
     Q_PROPERTY(TorStatus torStatus READ torStatus NOTIFY torStatusChanged)
-    // Whether it's possible to make a SOCKS connection and connect
+    // Whether it's possible to make a SOCKS connection and connect; Tor has
+    // finished bootstrapping, and our services have uploaded descriptors
     Q_PROPERTY(bool hasConnectivity READ hasConnectivity NOTIFY connectivityChanged)
     Q_PROPERTY(QString torVersion READ torVersion NOTIFY connected)
     Q_PROPERTY(QString errorMessage READ errorMessage NOTIFY statusChanged)
@@ -88,6 +92,9 @@ public:
     bool hasConnectivity() const;
     QHostAddress socksAddress() const;
     quint16 socksPort() const;
+    /* Path of Tor's SOCKS unix socket, if it has one. It's preferred over
+     * the TCP SOCKS port when set. */
+    QString socksSocketPath() const;
     QNetworkProxy connectionProxy();
 
     /* Authentication */
@@ -96,13 +103,26 @@ public:
     /* Connection */
     bool isConnected() const { return status() == Connected; }
     void connect(const QHostAddress &address, quint16 port);
+    /* Connect to a control port on a unix socket */
+    void connect(const QString &socketPath);
     void takeOwnership();
 
     /* Hidden Services */
     QList<HiddenService*> hiddenServices() const;
+    /* Add a service to publish whenever Tor is connected, starting now if
+     * it already is. Any number of services can share this connection. */
     void addHiddenService(HiddenService *service);
 
+    /* Fields of the last bootstrap status event, with lowercase keys (e.g.
+     * "progress", "tag", "summary"). "timings" maps each bootstrap phase tag
+     * to the milliseconds from connecting to the first report of that phase. */
     QVariantMap bootstrapStatus() const;
+
+    /* Events */
+    TorEvents *events() const;
+    ConnectionTimings *connectionTimings() const;
+    DescriptorProbe *descriptorProbe() const;
+
     Q_INVOKABLE QObject *getConfiguration(const QString &options);
     Q_INVOKABLE QObject *setConfiguration(const QVariantMap &options);
     Q_INVOKABLE PendingOperation *saveConfiguration();
@@ -40,11 +40,27 @@ TorControlCommand::TorControlCommand()
 {
 }
 
+void TorControlCommand::onReplyView(int statusCode, const QByteArray &data)
+{
+    onReply(statusCode, QByteArray(data.constData(), data.size()));
+}
+
+void TorControlCommand::onDataLineView(const QByteArray &data)
+{
+    onDataLine(QByteArray(data.constData(), data.size()));
+}
+
 void TorControlCommand::onReply(int statusCode, const QByteArray &data)
 {
     emit replyLine(statusCode, data);
 }
 
+void TorControlCommand::emitReplyLine(int statusCode, const QByteArray &data)
+{
+    if (receivers(SIGNAL(replyLine(int,QByteArray))) > 0)
+        emit replyLine(statusCode, QByteArray(data.constData(), data.size()));
+}
+
 void TorControlCommand::onFinished(int statusCode)
 {
     m_finalStatus = statusCode;
@@ -56,11 +56,30 @@ signals:
     void finished();
 
 protected:
+    /* Streaming reply interface
+     *
+     * These are called by TorControlSocket for each reply line, with 'data'
+     * referring directly into the socket's read buffer. The data is only
+     * valid for the duration of the call, and must be deep copied (with
+     * QByteArray(data.constData(), data.size())) if any part of it is kept;
+     * mid() or assignment would share the same buffer.
+     *
+     * The default implementations copy the line and call onReply or
+     * onDataLine. Commands that parse large replies override these instead,
+     * to avoid copying each line.
+     */
+    virtual void onReplyView(int statusCode, const QByteArray &data);
+    virtual void onDataLineView(const QByteArray &data);
+
     virtual void onReply(int statusCode, const QByteArray &data);
     virtual void onFinished(int statusCode);
     virtual void onDataLine(const QByteArray &data);
     virtual void onDataFinished();
 
+    /* Emit replyLine for a line from the streaming interface, copying it
+     * only if the signal is connected */
+    void emitReplyLine(int statusCode, const QByteArray &data);
+
 private:
     int m_finalStatus;
 };
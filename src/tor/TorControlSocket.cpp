@@ -32,10 +32,15 @@
 
 #include "TorControlSocket.h"
 #include "TorControlCommand.h"
+#include "utils/UnixSocket.h"
 #include <QDebug>
+#include <cstring>
 
 using namespace Tor;
 
+/* Longest line accepted from the control port, not including the CRLF */
+static const int maxLineLength = 5118;
+
 TorControlSocket::TorControlSocket(QObject *parent)
     : QTcpSocket(parent), currentCommand(0), inDataReply(false)
 {
@@ -55,11 +60,33 @@ void TorControlSocket::sendCommand(TorControlCommand *command, const QByteArray
     commandQueue.append(command);
     write(data);
 
-    qDebug() << "torctrl: Sent" << data.trimmed();
+    // ADD_ONION carries a private key, which must never be logged
+    if (data.startsWith("ADD_ONION "))
+        qDebug() << "torctrl: Sent ADD_ONION";
+    else
+        qDebug() << "torctrl: Sent" << data.trimmed();
+}
+
+void TorControlSocket::connectToPath(const QString &path)
+{
+    QString errorMessage;
+    if (!connectUnixSocket(this, path, &errorMessage)) {
+        QMetaObject::invokeMethod(this, "error", Qt::QueuedConnection, Q_ARG(QString, errorMessage));
+        return;
+    }
+
+    // The socket is connected already; signal it from the event loop, like connectToHost
+    QMetaObject::invokeMethod(this, "connected", Qt::QueuedConnection);
 }
 
 void TorControlSocket::registerEvent(const QByteArray &event, TorControlCommand *command)
 {
+    TorControlCommand *previous = eventCommands.value(event);
+    if (previous && previous != command) {
+        if (currentCommand == previous)
+            currentCommand = 0;
+        delete previous;
+    }
     eventCommands.insert(event, command);
 
     QByteArray data("SETEVENTS");
@@ -80,6 +107,7 @@ void TorControlSocket::clear()
     eventCommands.clear();
     inDataReply = false;
     currentCommand = 0;
+    readBuffer.clear();
 }
 
 void TorControlSocket::setError(const QString &message)
@@ -89,88 +117,132 @@ void TorControlSocket::setError(const QString &message)
     abort();
 }
 
+/* Read everything available into readBuffer, and parse each complete line
+ * in place. Only an incomplete line at the end is kept for the next call.
+ */
 void TorControlSocket::process()
 {
-    for (;;) {
-        if (!canReadLine())
-            return;
-
-        QByteArray line = readLine(5120);
-        if (!line.endsWith("\r\n")) {
-            setError(QStringLiteral("Invalid control message syntax"));
-            return;
-        }
-        line.chop(2);
-
-        if (inDataReply) {
-            if (line == ".") {
-                inDataReply = false;
-                if (currentCommand)
-                    currentCommand->onDataFinished();
-                currentCommand = 0;
-            } else {
-                if (currentCommand)
-                    currentCommand->onDataLine(line);
+    qint64 available = bytesAvailable();
+    if (available <= 0)
+        return;
+
+    // Parse from a local buffer, so commands that close the socket during a
+    // callback (which clears readBuffer) can't invalidate the lines being read
+    QByteArray buffer;
+    buffer.swap(readBuffer);
+
+    int offset = buffer.size();
+    buffer.resize(offset + int(available));
+    qint64 rd = read(buffer.data() + offset, available);
+    buffer.resize(offset + int(qMax<qint64>(rd, 0)));
+
+    const char *data = buffer.constData();
+    int size = buffer.size();
+    int pos = 0;
+
+    while (pos < size) {
+        const char *lineEnd = static_cast<const char*>(memchr(data + pos, '\n', size - pos));
+        if (!lineEnd) {
+            if (size - pos > maxLineLength + 1) {
+                setError(QStringLiteral("Invalid control message syntax"));
+                return;
             }
-            continue;
+            break;
         }
 
-        if (line.size() < 4) {
+        int lineSize = int(lineEnd - (data + pos));
+        if (lineSize < 1 || data[pos + lineSize - 1] != '\r' || lineSize - 1 > maxLineLength) {
             setError(QStringLiteral("Invalid control message syntax"));
             return;
         }
 
-        int statusCode = line.left(3).toInt();
-        char type = line[3];
-        bool isFinalReply = (type == ' ');
-        inDataReply = (type == '+');
+        if (!processLine(data + pos, lineSize - 1) || !isOpen())
+            return;
+        pos += lineSize + 1;
+    }
 
-        // Trim down to just data
-        line = line.mid(4);
+    buffer.remove(0, pos);
+    readBuffer.swap(buffer);
+}
 
-        if (!isFinalReply && !inDataReply && type != '-') {
-            setError(QStringLiteral("Invalid control message syntax"));
-            return;
+bool TorControlSocket::processLine(const char *data, int size)
+{
+    // A view into readBuffer, without copying the line
+    QByteArray line = QByteArray::fromRawData(data, size);
+
+    if (inDataReply) {
+        if (size == 1 && data[0] == '.') {
+            inDataReply = false;
+            if (currentCommand)
+                currentCommand->onDataFinished();
+            currentCommand = 0;
+        } else {
+            if (currentCommand)
+                currentCommand->onDataLineView(line);
         }
+        return true;
+    }
 
-        // 6xx replies are asynchronous responses
-        if (statusCode >= 600 && statusCode < 700) {
-            if (!currentCommand) {
-                int space = line.indexOf(' ');
-                if (space > 0)
-                    currentCommand = eventCommands.value(line.mid(0, space));
-
-                if (!currentCommand) {
-                    qWarning() << "torctrl: Ignoring unknown event";
-                    continue;
-                }
-            }
+    if (size < 4 || data[0] < '0' || data[0] > '9' || data[1] < '0' || data[1] > '9' ||
+        data[2] < '0' || data[2] > '9')
+    {
+        setError(QStringLiteral("Invalid control message syntax"));
+        return false;
+    }
+
+    int statusCode = (data[0] - '0') * 100 + (data[1] - '0') * 10 + (data[2] - '0');
+    char type = data[3];
+    bool isFinalReply = (type == ' ');
+    inDataReply = (type == '+');
 
-            currentCommand->onReply(statusCode, line);
-            if (isFinalReply) {
-                currentCommand->onFinished(statusCode);
-                currentCommand = 0;
+    // Trim down to just data
+    line = QByteArray::fromRawData(data + 4, size - 4);
+
+    if (!isFinalReply && !inDataReply && type != '-') {
+        setError(QStringLiteral("Invalid control message syntax"));
+        return false;
+    }
+
+    // 6xx replies are asynchronous responses
+    if (statusCode >= 600 && statusCode < 700) {
+        if (!currentCommand) {
+            const char *space = static_cast<const char*>(memchr(line.constData(), ' ', line.size()));
+            int keySize = space ? int(space - line.constData()) : line.size();
+            if (keySize > 0)
+                currentCommand = eventCommands.value(QByteArray::fromRawData(line.constData(), keySize));
+
+            if (!currentCommand) {
+                qWarning() << "torctrl: Ignoring unknown event";
+                return true;
             }
-            continue;
         }
 
-        if (commandQueue.isEmpty()) {
-            qWarning() << "torctrl: Received unexpected data";
-            continue;
+        currentCommand->onReplyView(statusCode, line);
+        if (isFinalReply) {
+            currentCommand->onFinished(statusCode);
+            currentCommand = 0;
         }
+        return true;
+    }
 
-        TorControlCommand *command = commandQueue.first();
-        if (command)
-            command->onReply(statusCode, line);
-
-        if (inDataReply) {
-            currentCommand = command;
-        } else if (isFinalReply) {
-            commandQueue.takeFirst();
-            if (command) {
-                command->onFinished(statusCode);
-                command->deleteLater();
-            }
+    if (commandQueue.isEmpty()) {
+        qWarning() << "torctrl: Received unexpected data";
+        return true;
+    }
+
+    TorControlCommand *command = commandQueue.first();
+    if (command)
+        command->onReplyView(statusCode, line);
+
+    if (inDataReply) {
+        currentCommand = command;
+    } else if (isFinalReply) {
+        commandQueue.takeFirst();
+        if (command) {
+            command->onFinished(statusCode);
+            command->deleteLater();
         }
     }
+
+    return true;
 }
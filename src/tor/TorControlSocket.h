@@ -51,6 +51,11 @@ public:
     QString errorMessage() const { return m_errorMessage; }
 
     void registerEvent(const QByteArray &event, TorControlCommand *handler);
+    bool isEventRegistered(const QByteArray &event) const { return eventCommands.contains(event); }
+
+    /* Connect to a control port on a unix socket. connected() or error()
+     * is emitted later, as for connectToHost. */
+    void connectToPath(const QString &path);
 
     void sendCommand(const QByteArray &data) { sendCommand(0, data); }
     void sendCommand(TorControlCommand *command, const QByteArray &data);
@@ -68,8 +73,12 @@ private:
     QString m_errorMessage;
     TorControlCommand *currentCommand;
     bool inDataReply;
+    /* Bytes read from the socket that have not been parsed yet; complete
+     * lines are passed to commands as views into this buffer. */
+    QByteArray readBuffer;
 
     void setError(const QString &message);
+    bool processLine(const char *line, int size);
 };
 
 }
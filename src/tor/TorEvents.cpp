@@ -0,0 +1,163 @@
+/* Ricochet - https://ricochet.im/
+ * Copyright (C) 2014, John Brooks <john.brooks@dereferenced.net>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *    * Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following disclaimer
+ *      in the documentation and/or other materials provided with the
+ *      distribution.
+ *
+ *    * Neither the names of the copyright owners nor the names of its
+ *      contributors may be used to endorse or promote products derived from
+ *      this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "TorEvents.h"
+#include "utils/StringUtil.h"
+#include <QHash>
+#include <QList>
+
+using namespace Tor;
+
+TorEvents::TorEvents(QObject *parent)
+    : QObject(parent)
+{
+}
+
+void TorEvents::enableEvents(EventTypes types)
+{
+    EventTypes enabled = m_enabled | types;
+    if (enabled == m_enabled)
+        return;
+
+    m_enabled = enabled;
+    emit enabledEventsChanged();
+}
+
+QByteArray TorEvents::eventName(EventType type)
+{
+    switch (type) {
+        case CircuitEvents: return QByteArrayLiteral("CIRC");
+        case StreamEvents: return QByteArrayLiteral("STREAM");
+        case HsDescEvents: return QByteArrayLiteral("HS_DESC");
+        case BandwidthEvents: return QByteArrayLiteral("BW");
+    }
+    return QByteArray();
+}
+
+/* Keyword arguments are "KEY=value", with an uppercase key. Circuit paths
+ * (e.g. "$fingerprint=nickname") also contain '=', but start with '$'. */
+static bool isKeywordArgument(const QByteArray &token, int *equals)
+{
+    *equals = token.indexOf('=');
+    if (*equals < 1)
+        return false;
+
+    for (int i = 0; i < *equals; i++) {
+        char c = token[i];
+        if (!((c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_'))
+            return false;
+    }
+    return true;
+}
+
+static void parseArguments(const QByteArray &data, QList<QByteArray> *positional,
+                           QHash<QByteArray,QByteArray> *keywords)
+{
+    QList<QByteArray> tokens = splitQuotedStrings(data.trimmed(), ' ');
+    foreach (const QByteArray &token, tokens) {
+        if (token.isEmpty())
+            continue;
+
+        int equals;
+        if (isKeywordArgument(token, &equals))
+            keywords->insert(token.left(equals), unquotedString(token.mid(equals + 1)));
+        else if (keywords->isEmpty())
+            positional->append(token);
+    }
+}
+
+void TorEvents::handleEvent(const QByteArray &data)
+{
+    QList<QByteArray> args;
+    QHash<QByteArray,QByteArray> keywords;
+    parseArguments(data, &args, &keywords);
+    if (args.isEmpty())
+        return;
+
+    const QByteArray &type = args[0];
+
+    if (type == "CIRC") {
+        // CIRC <CircuitID> <CircStatus> [<Path>] [KEYWORD=value...]
+        if (args.size() < 3)
+            return;
+
+        CircuitEvent event;
+        event.circuitId = args[1];
+        event.status = args[2];
+        event.purpose = keywords.value("PURPOSE");
+        event.hsState = keywords.value("HS_STATE");
+        event.reason = keywords.value("REASON");
+        event.rendQuery = OnionAddress::fromString(keywords.value("REND_QUERY"));
+        emit circuitEvent(event);
+    } else if (type == "STREAM") {
+        // STREAM <StreamID> <StreamStatus> <CircuitID> <Target> [KEYWORD=value...]
+        if (args.size() < 5)
+            return;
+
+        StreamEvent event;
+        event.streamId = args[1];
+        event.status = args[2];
+        event.circuitId = args[3];
+        event.reason = keywords.value("REASON");
+
+        int sepp = args[4].lastIndexOf(':');
+        if (sepp >= 0) {
+            event.targetHost = QString::fromLatin1(args[4].left(sepp));
+            event.targetPort = quint16(args[4].mid(sepp + 1).toUShort());
+        } else {
+            event.targetHost = QString::fromLatin1(args[4]);
+        }
+
+        if (event.targetHost.endsWith(QLatin1String(".onion")))
+            event.target = OnionAddress::fromString(event.targetHost);
+        emit streamEvent(event);
+    } else if (type == "HS_DESC") {
+        // HS_DESC <Action> <HSAddress> <AuthType> <HsDir> [<DescriptorID>] [KEYWORD=value...]
+        if (args.size() < 5)
+            return;
+
+        HsDescEvent event;
+        event.action = args[1];
+        event.address = OnionAddress::fromString(args[2]);
+        event.hsDir = args[4];
+        event.descriptorId = args.value(5);
+        event.reason = keywords.value("REASON");
+        emit hsDescEvent(event);
+    } else if (type == "BW") {
+        // BW <BytesRead> <BytesWritten> [KEYWORD=value...]
+        if (args.size() < 3)
+            return;
+
+        emit bandwidth(args[1].toULongLong(), args[2].toULongLong());
+    }
+}
@@ -0,0 +1,137 @@
+/* Ricochet - https://ricochet.im/
+ * Copyright (C) 2014, John Brooks <john.brooks@dereferenced.net>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *    * Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following disclaimer
+ *      in the documentation and/or other materials provided with the
+ *      distribution.
+ *
+ *    * Neither the names of the copyright owners nor the names of its
+ *      contributors may be used to endorse or promote products derived from
+ *      this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef TOREVENTS_H
+#define TOREVENTS_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QString>
+#include "utils/OnionAddress.h"
+
+namespace Tor
+{
+
+/* Parsed forms of the asynchronous control port events that Ricochet uses
+ *
+ * Fields hold the tokens as Tor sent them (e.g. status "BUILT"); keyword
+ * arguments that weren't present are empty. Onion addresses from the
+ * event are parsed into OnionAddress, which is invalid for events that
+ * aren't related to an onion service.
+ */
+struct CircuitEvent
+{
+    QByteArray circuitId;
+    QByteArray status;
+    QByteArray purpose;
+    QByteArray hsState;
+    QByteArray reason;
+    OnionAddress rendQuery;
+};
+
+struct StreamEvent
+{
+    QByteArray streamId;
+    QByteArray status;
+    QByteArray circuitId;
+    QByteArray reason;
+    QString targetHost;
+    quint16 targetPort;
+    OnionAddress target;
+
+    StreamEvent() : targetPort(0) { }
+};
+
+struct HsDescEvent
+{
+    QByteArray action;
+    QByteArray hsDir;
+    QByteArray descriptorId;
+    QByteArray reason;
+    OnionAddress address;
+};
+
+/* Event bus for CIRC, STREAM, HS_DESC and BW control port events
+ *
+ * TorEvents is owned by TorControl and lives as long as it does, so
+ * consumers can connect to its signals once and keep receiving events
+ * across control connections. TorControl subscribes (with SETEVENTS) to
+ * every enabled event type after authenticating; enabling more types while
+ * connected subscribes to them immediately.
+ *
+ * Event types are only enabled by the consumers that need them. BW in
+ * particular is emitted every second, and shouldn't be enabled unless
+ * something is displaying it.
+ */
+class TorEvents : public QObject
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(TorEvents)
+
+public:
+    enum EventType {
+        CircuitEvents = 0x1,
+        StreamEvents = 0x2,
+        HsDescEvents = 0x4,
+        BandwidthEvents = 0x8
+    };
+    Q_DECLARE_FLAGS(EventTypes, EventType)
+
+    explicit TorEvents(QObject *parent = 0);
+
+    EventTypes enabledEvents() const { return m_enabled; }
+    void enableEvents(EventTypes types);
+
+    /* Control port event keyword for a single EventType */
+    static QByteArray eventName(EventType type);
+
+    /* Parse one event line (without the "650 " prefix) and emit it */
+    void handleEvent(const QByteArray &data);
+
+signals:
+    void enabledEventsChanged();
+
+    void circuitEvent(const Tor::CircuitEvent &event);
+    void streamEvent(const Tor::StreamEvent &event);
+    void hsDescEvent(const Tor::HsDescEvent &event);
+    void bandwidth(quint64 bytesRead, quint64 bytesWritten);
+
+private:
+    EventTypes m_enabled;
+};
+
+}
+
+Q_DECLARE_OPERATORS_FOR_FLAGS(Tor::TorEvents::EventTypes)
+
+#endif // TOREVENTS_H
@@ -0,0 +1,252 @@
+/* Ricochet - https://ricochet.im/
+ * Copyright (C) 2014, John Brooks <john.brooks@dereferenced.net>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *    * Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following disclaimer
+ *      in the documentation and/or other materials provided with the
+ *      distribution.
+ *
+ *    * Neither the names of the copyright owners nor the names of its
+ *      contributors may be used to endorse or promote products derived from
+ *      this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "TorLog.h"
+#include "utils/Useful.h"
+#include <cstring>
+
+using namespace Tor;
+
+static QDateTime parseTimestamp(const QByteArray &text)
+{
+    // "Oct 18 13:45:18.123"; the year isn't included
+    static const char months[][4] = {
+        "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+    };
+
+    QList<QByteArray> parts = text.split(' ');
+    parts.removeAll(QByteArray());
+    if (parts.size() != 3)
+        return QDateTime();
+
+    int month = 0;
+    for (int i = 0; i < 12; i++) {
+        if (parts[0] == months[i]) {
+            month = i + 1;
+            break;
+        }
+    }
+
+    int day = parts[1].toInt();
+    QTime time = QTime::fromString(QString::fromLatin1(parts[2]), QStringLiteral("HH:mm:ss.zzz"));
+    if (!time.isValid())
+        time = QTime::fromString(QString::fromLatin1(parts[2]), QStringLiteral("HH:mm:ss"));
+    if (!month || !time.isValid())
+        return QDateTime();
+
+    QDate today = QDate::currentDate();
+    QDate date(today.year(), month, day);
+    // Lines from the end of last year, read just after the new year
+    if (date.isValid() && date > today.addDays(1))
+        date = QDate(today.year() - 1, month, day);
+    if (!date.isValid())
+        return QDateTime();
+
+    return QDateTime(date, time);
+}
+
+TorLogRecord TorLogRecord::parse(const QByteArray &line)
+{
+    TorLogRecord record;
+
+    int open = line.indexOf(" [");
+    int close = (open >= 0) ? line.indexOf("] ", open) : -1;
+    if (open < 0 || close < 0) {
+        record.message = QString::fromLatin1(line);
+        return record;
+    }
+
+    QByteArray severity = line.mid(open + 2, close - open - 2);
+    if (severity == "notice")
+        record.severity = Notice;
+    else if (severity == "warn")
+        record.severity = Warning;
+    else if (severity == "err")
+        record.severity = Error;
+    else if (severity == "info")
+        record.severity = Info;
+    else if (severity == "debug")
+        record.severity = Debug;
+    else {
+        record.message = QString::fromLatin1(line);
+        return record;
+    }
+
+    record.timestamp = parseTimestamp(line.left(open));
+
+    int pos = close + 2;
+    if (line.size() > pos && line[pos] == '{') {
+        int end = line.indexOf("} ", pos);
+        if (end > pos) {
+            record.subsystem = QString::fromLatin1(line.mid(pos + 1, end - pos - 1));
+            pos = end + 2;
+        }
+    }
+
+    // Warnings are usually prefixed with the function that logged them
+    int function = line.indexOf("(): ", pos);
+    if (function > pos && line.indexOf(' ', pos) > function) {
+        if (record.subsystem.isEmpty())
+            record.subsystem = QString::fromLatin1(line.mid(pos, function - pos));
+        pos = function + 4;
+    }
+
+    record.message = QString::fromLatin1(line.mid(pos));
+    return record;
+}
+
+QString TorLogRecord::severityName(Severity severity)
+{
+    switch (severity) {
+        case Debug: return QStringLiteral("debug");
+        case Info: return QStringLiteral("info");
+        case Notice: return QStringLiteral("notice");
+        case Warning: return QStringLiteral("warn");
+        case Error: return QStringLiteral("err");
+        case Unknown: break;
+    }
+    return QString();
+}
+
+QString TorLogRecord::toString() const
+{
+    if (severity == Unknown)
+        return message;
+
+    QString re;
+    if (timestamp.isValid())
+        re = timestamp.time().toString(QStringLiteral("HH:mm:ss.zzz "));
+    re += QLatin1Char('[') + severityName(severity) + QLatin1String("] ");
+    if (!subsystem.isEmpty())
+        re += subsystem + QLatin1String(": ");
+    re += message;
+    return re;
+}
+
+TorLog::TorLog(QObject *parent)
+    : QObject(parent), m_records(DefaultCapacity), m_head(0), m_count(0)
+{
+    memset(m_severityCounts, 0, sizeof(m_severityCounts));
+}
+
+void TorLog::setCapacity(int capacity)
+{
+    if (capacity < 1 || capacity == m_records.size())
+        return;
+
+    QList<TorLogRecord> recent = records();
+    if (recent.size() > capacity)
+        recent = recent.mid(recent.size() - capacity);
+
+    m_records = QVector<TorLogRecord>(capacity);
+    m_head = 0;
+    m_count = 0;
+    foreach (const TorLogRecord &record, recent) {
+        m_records[m_count++] = record;
+    }
+    m_head = m_count % capacity;
+    emit changed();
+}
+
+const TorLogRecord &TorLog::at(int index) const
+{
+    if (index < 0 || index >= m_count) {
+        BUG() << "TorLog index" << index << "out of range";
+        static const TorLogRecord empty;
+        return empty;
+    }
+
+    int first = (m_head - m_count + m_records.size()) % m_records.size();
+    return m_records[(first + index) % m_records.size()];
+}
+
+QList<TorLogRecord> TorLog::records() const
+{
+    QList<TorLogRecord> re;
+    re.reserve(m_count);
+    for (int i = 0; i < m_count; i++)
+        re.append(at(i));
+    return re;
+}
+
+QStringList TorLog::messages() const
+{
+    QStringList re;
+    re.reserve(m_count);
+    for (int i = 0; i < m_count; i++)
+        re.append(at(i).toString());
+    return re;
+}
+
+QVariantMap TorLog::bootstrapTimings() const
+{
+    return m_bootstrapTimings;
+}
+
+void TorLog::append(const TorLogRecord &record)
+{
+    if (!m_clock.isValid())
+        m_clock.start();
+
+    m_records[m_head] = record;
+    m_head = (m_head + 1) % m_records.size();
+    if (m_count < m_records.size())
+        m_count++;
+
+    m_severityCounts[record.severity]++;
+
+    // "Bootstrapped 5%: ..." or "Bootstrapped 5% (conn): ..."
+    if (record.message.startsWith(QLatin1String("Bootstrapped "))) {
+        int percent = record.message.indexOf(QLatin1Char('%'));
+        if (percent > 13) {
+            QString key = record.message.mid(13, percent - 13);
+            if (!m_bootstrapTimings.contains(key))
+                m_bootstrapTimings.insert(key, m_clock.elapsed());
+        }
+    }
+
+    emit recordAdded(record);
+    emit messageAdded(record.toString());
+    emit changed();
+}
+
+void TorLog::clear()
+{
+    m_records = QVector<TorLogRecord>(m_records.size());
+    m_head = 0;
+    m_count = 0;
+    memset(m_severityCounts, 0, sizeof(m_severityCounts));
+    m_bootstrapTimings.clear();
+    m_clock.invalidate();
+    emit changed();
+}
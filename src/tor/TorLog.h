@@ -0,0 +1,140 @@
+/* Ricochet - https://ricochet.im/
+ * Copyright (C) 2014, John Brooks <john.brooks@dereferenced.net>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *    * Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following disclaimer
+ *      in the documentation and/or other materials provided with the
+ *      distribution.
+ *
+ *    * Neither the names of the copyright owners nor the names of its
+ *      contributors may be used to endorse or promote products derived from
+ *      this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef TORLOG_H
+#define TORLOG_H
+
+#include <QObject>
+#include <QVector>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QStringList>
+#include <QVariantMap>
+
+namespace Tor
+{
+
+/* One line of Tor's log output, split into its fields
+ *
+ * Tor writes lines like "Oct 18 13:45:18.123 [notice] Bootstrapped 5%: ...".
+ * The subsystem is the log domain in braces (with LogMessageDomains 1) or
+ * the function name before "():", and is empty when neither is present.
+ * Lines that don't have this form are kept whole as the message, with an
+ * Unknown severity.
+ */
+struct TorLogRecord
+{
+    enum Severity {
+        Unknown,
+        Debug,
+        Info,
+        Notice,
+        Warning,
+        Error
+    };
+
+    Severity severity;
+    QDateTime timestamp;
+    QString subsystem;
+    QString message;
+
+    TorLogRecord() : severity(Unknown) { }
+
+    static TorLogRecord parse(const QByteArray &line);
+    static QString severityName(Severity severity);
+
+    /* Formatted for display, as "13:45:18.123 [notice] message" */
+    QString toString() const;
+};
+
+/* Fixed-capacity ring buffer of recent Tor log records
+ *
+ * Appending is constant time; once full, the oldest record is overwritten.
+ * Counters of warnings and errors, and the time at which each bootstrap
+ * percentage was first logged, are kept for the whole lifetime of the log,
+ * so they can be read without scanning the buffer.
+ */
+class TorLog : public QObject
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(TorLog)
+
+    Q_PROPERTY(QStringList messages READ messages NOTIFY changed)
+    Q_PROPERTY(int warningCount READ warningCount NOTIFY changed)
+    Q_PROPERTY(int errorCount READ errorCount NOTIFY changed)
+    Q_PROPERTY(QVariantMap bootstrapTimings READ bootstrapTimings NOTIFY changed)
+
+public:
+    static const int DefaultCapacity = 50;
+
+    explicit TorLog(QObject *parent = 0);
+
+    int capacity() const { return m_records.size(); }
+    /* Changing the capacity keeps the most recent records that fit */
+    void setCapacity(int capacity);
+
+    int size() const { return m_count; }
+    /* Record at index, where 0 is the oldest record in the buffer */
+    const TorLogRecord &at(int index) const;
+    QList<TorLogRecord> records() const;
+    QStringList messages() const;
+
+    int warningCount() const { return count(TorLogRecord::Warning); }
+    int errorCount() const { return count(TorLogRecord::Error); }
+    int count(TorLogRecord::Severity severity) const { return m_severityCounts[severity]; }
+
+    /* Milliseconds from the first record to the first "Bootstrapped N%"
+     * message for each percentage, keyed by the percentage as a string */
+    QVariantMap bootstrapTimings() const;
+
+    void append(const TorLogRecord &record);
+    void clear();
+
+signals:
+    void recordAdded(const Tor::TorLogRecord &record);
+    /* Emitted with each appended record as formatted by toString() */
+    void messageAdded(const QString &message);
+    void changed();
+
+private:
+    QVector<TorLogRecord> m_records;
+    int m_head;
+    int m_count;
+    int m_severityCounts[TorLogRecord::Error + 1];
+    QElapsedTimer m_clock;
+    QVariantMap m_bootstrapTimings;
+};
+
+}
+
+#endif // TORLOG_H
@@ -33,11 +33,14 @@
 #include "TorManager.h"
 #include "TorProcess.h"
 #include "TorControl.h"
+#include "TorLog.h"
 #include "GetConfCommand.h"
 #include "utils/Settings.h"
+#include "utils/UnixSocket.h"
 #include <QFile>
 #include <QDir>
 #include <QCoreApplication>
+#include <QElapsedTimer>
 
 using namespace Tor;
 
@@ -53,9 +56,11 @@ public:
     TorProcess *process;
     TorControl *control;
     QString dataDir;
-    QStringList logMessages;
+    TorLog *log;
     QString errorMessage;
+    QElapsedTimer startTimer;
     bool configNeeded;
+    bool bootstrapped;
 
     explicit TorManagerPrivate(TorManager *parent = 0);
 
@@ -68,8 +73,9 @@ public:
 public slots:
     void processStateChanged(int state);
     void processErrorChanged(const QString &errorMessage);
-    void processLogMessage(const QString &message);
+    void processLogRecord(const Tor::TorLogRecord &record);
     void controlStatusChanged(int status);
+    void bootstrapStatusChanged();
     void getConfFinished();
 };
 
@@ -85,9 +91,16 @@ TorManagerPrivate::TorManagerPrivate(TorManager *parent)
     , q(parent)
     , process(0)
     , control(new TorControl(this))
+    , log(new TorLog(this))
     , configNeeded(false)
+    , bootstrapped(false)
 {
+    SettingsObject settings(QStringLiteral("tor"));
+    log->setCapacity(settings.read("logBufferSize", TorLog::DefaultCapacity).toInt());
+    connect(log, &TorLog::changed, q, &TorManager::logMessagesChanged);
+
     connect(control, SIGNAL(statusChanged(int,int)), SLOT(controlStatusChanged(int)));
+    connect(control, SIGNAL(bootstrapStatusChanged()), SLOT(bootstrapStatusChanged()));
 }
 
 TorManager *TorManager::instance()
@@ -103,6 +116,11 @@ TorControl *TorManager::control()
     return d->control;
 }
 
+TorLog *TorManager::log()
+{
+    return d->log;
+}
+
 TorProcess *TorManager::process()
 {
     return d->process;
@@ -127,7 +145,12 @@ bool TorManager::configurationNeeded() const
 
 QStringList TorManager::logMessages() const
 {
-    return d->logMessages;
+    return d->log->messages();
+}
+
+qint64 TorManager::elapsedSinceStart() const
+{
+    return d->startTimer.isValid() ? d->startTimer.elapsed() : -1;
 }
 
 bool TorManager::hasError() const
@@ -147,8 +170,11 @@ void TorManager::start()
         emit errorChanged();
     }
 
+    d->startTimer.start();
+    d->bootstrapped = false;
+
     SettingsObject settings(QStringLiteral("tor"));
-    if (settings.read("controlPort").isUndefined()) {
+    if (settings.read("controlPort").isUndefined() && settings.read("controlSocket").isUndefined()) {
         // Launch a bundled Tor instance
         QString executable = d->torExecutablePath();
         if (executable.isEmpty()) {
@@ -161,7 +187,7 @@ void TorManager::start()
             connect(d->process, SIGNAL(stateChanged(int)), d, SLOT(processStateChanged(int)));
             connect(d->process, SIGNAL(errorMessageChanged(QString)), d,
                     SLOT(processErrorChanged(QString)));
-            connect(d->process, SIGNAL(logMessage(QString)), d, SLOT(processLogMessage(QString)));
+            connect(d->process, &TorProcess::logRecord, d, &TorManagerPrivate::processLogRecord);
         }
 
         if (!QFile::exists(d->dataDir) && !d->createDataDir(d->dataDir)) {
@@ -181,10 +207,24 @@ void TorManager::start()
             emit configurationNeededChanged();
         }
 
+        /* Warm start mode lets Tor keep its cached consensus, descriptors and
+         * guard state on disk, which default_torrc otherwise avoids writing.
+         * Command line options override both torrc files. A configured torrc
+         * already enables the network, so Tor connects from launch. */
+        QStringList extraSettings;
+        if (settings.read("warmStart").toBool())
+            extraSettings << QStringLiteral("AvoidDiskWrites") << QStringLiteral("0");
+
         d->process->setExecutable(executable);
         d->process->setDataDir(d->dataDir);
         d->process->setDefaultTorrc(defaultTorrc);
+        d->process->setExtraSettings(extraSettings);
+        d->process->setUnixSockets(settings.read("unixSockets").toBool() && isUnixSocketSupported()
+                                   && !d->dataDir.contains(QLatin1Char(' ')));
         d->process->start();
+    } else if (!settings.read("controlSocket").toString().isEmpty()) {
+        d->control->setAuthPassword(settings.read("controlPassword").toString().toLatin1());
+        d->control->connect(settings.read("controlSocket").toString());
     } else {
         QHostAddress address(settings.read("controlAddress").toString());
         quint16 port = (quint16)settings.read("controlPort").toInt();
@@ -201,7 +241,10 @@ void TorManagerPrivate::processStateChanged(int state)
     qDebug() << Q_FUNC_INFO << state << TorProcess::Ready << process->controlPassword() << process->controlHost() << process->controlPort();
     if (state == TorProcess::Ready) {
         control->setAuthPassword(process->controlPassword());
-        control->connect(process->controlHost(), process->controlPort());
+        if (!process->controlSocketPath().isEmpty())
+            control->connect(process->controlSocketPath());
+        else
+            control->connect(process->controlHost(), process->controlPort());
     }
 }
 
@@ -211,12 +254,10 @@ void TorManagerPrivate::processErrorChanged(const QString &errorMessage)
     setError(errorMessage);
 }
 
-void TorManagerPrivate::processLogMessage(const QString &message)
+void TorManagerPrivate::processLogRecord(const TorLogRecord &record)
 {
-    qDebug() << "tor:" << message;
-    if (logMessages.size() >= 50)
-        logMessages.takeFirst();
-    logMessages.append(message);
+    qDebug() << "tor:" << record.toString();
+    log->append(record);
 }
 
 void TorManagerPrivate::controlStatusChanged(int status)
@@ -235,6 +276,20 @@ void TorManagerPrivate::controlStatusChanged(int status)
     }
 }
 
+void TorManagerPrivate::bootstrapStatusChanged()
+{
+    QVariantMap status = control->bootstrapStatus();
+    if (status.value(QStringLiteral("progress")).toInt() < 100)
+        return;
+
+    // Tor repeats the 100% status, e.g. after the network is re-enabled
+    if (bootstrapped)
+        return;
+
+    bootstrapped = true;
+    qDebug() << "Tor bootstrapped" << startTimer.elapsed() << "ms after starting";
+}
+
 void TorManagerPrivate::getConfFinished()
 {
     GetConfCommand *command = qobject_cast<GetConfCommand*>(sender());
@@ -41,6 +41,7 @@ namespace Tor
 
 class TorProcess;
 class TorControl;
+class TorLog;
 class TorManagerPrivate;
 
 /* Run/connect to an instance of Tor according to configuration, and manage
@@ -50,7 +51,8 @@ class TorManager : public QObject
     Q_OBJECT
 
     Q_PROPERTY(bool configurationNeeded READ configurationNeeded NOTIFY configurationNeededChanged)
-    Q_PROPERTY(QStringList logMessages READ logMessages CONSTANT)
+    Q_PROPERTY(QStringList logMessages READ logMessages NOTIFY logMessagesChanged)
+    Q_PROPERTY(Tor::TorLog* log READ log CONSTANT)
     Q_PROPERTY(Tor::TorProcess* process READ process CONSTANT)
     Q_PROPERTY(Tor::TorControl* control READ control CONSTANT)
     Q_PROPERTY(bool hasError READ hasError NOTIFY errorChanged)
@@ -63,6 +65,9 @@ public:
 
     TorProcess *process();
     TorControl *control();
+    /* Recent log records from the bundled Tor instance, with counters of
+     * warnings and bootstrap progress */
+    TorLog *log();
 
     QString dataDirectory() const;
     void setDataDirectory(const QString &path);
@@ -72,6 +77,11 @@ public:
 
     QStringList logMessages() const;
 
+    /* Milliseconds since start() was called, or -1 before starting. Used to
+     * measure the time from launch to bootstrapping and to contacts being
+     * reachable. */
+    qint64 elapsedSinceStart() const;
+
     bool hasError() const;
     QString errorMessage() const;
 
@@ -81,6 +91,7 @@ public slots:
 signals:
     void configurationNeededChanged();
     void errorChanged();
+    void logMessagesChanged();
 
 private:
     TorManagerPrivate *d;
@@ -51,7 +51,7 @@ TorProcess::~TorProcess()
 }
 
 TorProcessPrivate::TorProcessPrivate(TorProcess *q)
-    : QObject(q), q(q), state(TorProcess::NotStarted), controlPort(0), controlPortAttempts(0)
+    : QObject(q), q(q), state(TorProcess::NotStarted), controlPort(0), unixSockets(false), controlPortWatcher(0)
 {
     connect(&process, &QProcess::started, this, &TorProcessPrivate::processStarted);
     connect(&process, (void (QProcess::*)(int, QProcess::ExitStatus))&QProcess::finished,
@@ -104,6 +104,16 @@ void TorProcess::setExtraSettings(const QStringList &settings)
     d->extraSettings = settings;
 }
 
+bool TorProcess::unixSockets() const
+{
+    return d->unixSockets;
+}
+
+void TorProcess::setUnixSockets(bool enabled)
+{
+    d->unixSockets = enabled;
+}
+
 TorProcess::State TorProcess::state() const
 {
     return d->state;
@@ -151,7 +161,12 @@ void TorProcess::start()
     args << QStringLiteral("-f") << d->torrcPath();
     args << QStringLiteral("DataDirectory") << d->dataDir;
     args << QStringLiteral("HashedControlPassword") << QString::fromLatin1(hashedPassword);
-    args << QStringLiteral("ControlPort") << QStringLiteral("auto");
+    if (d->unixSockets) {
+        args << QStringLiteral("ControlPort") << QStringLiteral("unix:") + d->socketPath(QStringLiteral("control"));
+        args << QStringLiteral("SocksPort") << QStringLiteral("unix:") + d->socketPath(QStringLiteral("socks"));
+    } else {
+        args << QStringLiteral("ControlPort") << QStringLiteral("auto");
+    }
     args << QStringLiteral("ControlPortWriteToFile") << d->controlPortFilePath();
     args << QStringLiteral("__OwningControllerProcess") << QString::number(qApp->applicationPid());
     args << d->extraSettings;
@@ -163,6 +178,7 @@ void TorProcess::start()
         QFile::remove(d->controlPortFilePath());
     d->controlPort = 0;
     d->controlHost.clear();
+    d->controlSocketPath.clear();
 
     d->process.setProcessChannelMode(QProcess::MergedChannels);
     d->process.start(d->executable, args, QIODevice::ReadOnly);
@@ -173,7 +189,7 @@ void TorProcess::stop()
     if (state() < Starting)
         return;
 
-    d->controlPortTimer.stop();
+    d->stopControlPortDiscovery();
 
     if (d->process.state() == QProcess::Starting)
         d->process.waitForStarted(2000);
@@ -214,6 +230,11 @@ quint16 TorProcess::controlPort()
     return d->controlPort;
 }
 
+QString TorProcess::controlSocketPath()
+{
+    return d->controlSocketPath;
+}
+
 bool TorProcessPrivate::ensureFilesExist()
 {
     QFile torrc(torrcPath());
@@ -243,13 +264,26 @@ QString TorProcessPrivate::controlPortFilePath() const
     return QDir::toNativeSeparators(dataDir) + QDir::separator() + QStringLiteral("control-port");
 }
 
+QString TorProcessPrivate::socketPath(const QString &name) const
+{
+    return QDir(dataDir).absoluteFilePath(name + QStringLiteral(".sock"));
+}
+
 void TorProcessPrivate::processStarted()
 {
     state = TorProcess::Connecting;
     emit q->stateChanged(state);
 
-    controlPortAttempts = 0;
+    // The control port file is written into the data directory once Tor is listening
+    if (!controlPortWatcher) {
+        controlPortWatcher = new QFileSystemWatcher(this);
+        connect(controlPortWatcher, &QFileSystemWatcher::directoryChanged, this, &TorProcessPrivate::tryReadControlPort);
+    }
+    controlPortWatcher->addPath(dataDir);
+
+    controlPortElapsed.start();
     controlPortTimer.start();
+    tryReadControlPort();
 }
 
 void TorProcessPrivate::processFinished()
@@ -257,7 +291,7 @@ void TorProcessPrivate::processFinished()
     if (state < TorProcess::Starting)
         return;
 
-    controlPortTimer.stop();
+    stopControlPortDiscovery();
     errorMessage = process.errorString();
     if (errorMessage.isEmpty())
         errorMessage = QStringLiteral("Process exited unexpectedly (code %1)").arg(process.exitCode());
@@ -276,36 +310,112 @@ void TorProcessPrivate::processReadable()
 {
     while (process.bytesAvailable() > 0) {
         QByteArray line = process.readLine(2048).trimmed();
-        if (!line.isEmpty())
-            emit q->logMessage(QString::fromLatin1(line));
+        if (line.isEmpty())
+            continue;
+
+        if (state == TorProcess::Connecting)
+            parseControlListener(line);
+        emit q->logRecord(TorLogRecord::parse(line));
     }
 }
 
-void TorProcessPrivate::tryReadControlPort()
+/* Tor logs "Opened Control listener on 127.0.0.1:9051" (with "connection (ready)"
+ * after "listener" in newer versions) when the control port is available. */
+void TorProcessPrivate::parseControlListener(const QByteArray &line)
+{
+    int p = line.indexOf("Opened Control listener");
+    if (p < 0)
+        return;
+    p = line.indexOf(" on ", p);
+    if (p < 0)
+        return;
+
+    QByteArray address = line.mid(p + 4).trimmed();
+    if (address.startsWith('/')) {
+        setControlSocketPath(QFile::decodeName(address));
+        return;
+    }
+
+    int sep = address.lastIndexOf(':');
+    if (sep < 1)
+        return;
+
+    QHostAddress host(QString::fromLatin1(address.left(sep)));
+    quint16 port = address.mid(sep + 1).toUShort();
+    if (!host.isNull() && port > 0)
+        setControlPort(host, port);
+}
+
+bool TorProcessPrivate::readControlPortFile()
 {
     QFile file(controlPortFilePath());
-    if (file.open(QIODevice::ReadOnly)) {
-        QByteArray data = file.readLine().trimmed();
-
-        int p;
-        if (data.startsWith("PORT=") && (p = data.lastIndexOf(':')) > 0) {
-            controlHost = QHostAddress(QString::fromLatin1(data.mid(5, p - 5)));
-            controlPort = data.mid(p+1).toUShort();
-
-            if (!controlHost.isNull() && controlPort > 0) {
-                controlPortTimer.stop();
-                state = TorProcess::Ready;
-                emit q->stateChanged(state);
-                return;
-            }
-        }
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    QByteArray data = file.readLine().trimmed();
+
+    if (data.startsWith("UNIX_PORT=")) {
+        setControlSocketPath(QFile::decodeName(data.mid(10)));
+        return true;
     }
 
-    if (++controlPortAttempts * controlPortTimer.interval() > 10000) {
+    int p;
+    if (!data.startsWith("PORT=") || (p = data.lastIndexOf(':')) <= 0)
+        return false;
+
+    QHostAddress host(QString::fromLatin1(data.mid(5, p - 5)));
+    quint16 port = data.mid(p+1).toUShort();
+    if (host.isNull() || port == 0)
+        return false;
+
+    setControlPort(host, port);
+    return true;
+}
+
+void TorProcessPrivate::setControlPort(const QHostAddress &host, quint16 port)
+{
+    if (state != TorProcess::Connecting)
+        return;
+
+    controlHost = host;
+    controlPort = port;
+    qDebug() << "Tor control port is available after" << controlPortElapsed.elapsed() << "ms";
+
+    stopControlPortDiscovery();
+    state = TorProcess::Ready;
+    emit q->stateChanged(state);
+}
+
+void TorProcessPrivate::setControlSocketPath(const QString &path)
+{
+    if (state != TorProcess::Connecting)
+        return;
+
+    controlSocketPath = path;
+    qDebug() << "Tor control socket is available after" << controlPortElapsed.elapsed() << "ms";
+
+    stopControlPortDiscovery();
+    state = TorProcess::Ready;
+    emit q->stateChanged(state);
+}
+
+void TorProcessPrivate::stopControlPortDiscovery()
+{
+    controlPortTimer.stop();
+    if (controlPortWatcher && !controlPortWatcher->directories().isEmpty())
+        controlPortWatcher->removePaths(controlPortWatcher->directories());
+}
+
+void TorProcessPrivate::tryReadControlPort()
+{
+    if (state != TorProcess::Connecting || readControlPortFile())
+        return;
+
+    if (controlPortElapsed.elapsed() > 10000) {
+        stopControlPortDiscovery();
         errorMessage = QStringLiteral("No control port available after launching process");
         state = TorProcess::Failed;
         emit q->errorMessageChanged(errorMessage);
         emit q->stateChanged(state);
     }
 }
-
@@ -35,6 +35,7 @@
 
 #include <QObject>
 #include <QHostAddress>
+#include "TorLog.h"
 
 namespace Tor
 {
@@ -75,10 +76,17 @@ public:
     QStringList extraSettings() const;
     void setExtraSettings(const QStringList &settings);
 
+    /* Use unix sockets in the data directory for the control and SOCKS
+     * ports, instead of TCP ports on localhost */
+    bool unixSockets() const;
+    void setUnixSockets(bool enabled);
+
     State state() const;
     QString errorMessage() const;
     QHostAddress controlHost();
     quint16 controlPort();
+    /* Path of the control socket when using unix sockets */
+    QString controlSocketPath();
     QByteArray controlPassword();
 
 public slots:
@@ -88,7 +96,7 @@ public slots:
 signals:
     void stateChanged(int newState);
     void errorMessageChanged(const QString &errorMessage);
-    void logMessage(const QString &message);
+    void logRecord(const Tor::TorLogRecord &record);
 
 private:
     TorProcessPrivate *d;
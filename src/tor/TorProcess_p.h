@@ -36,6 +36,8 @@
 #include "TorProcess.h"
 #include <QProcess>
 #include <QTimer>
+#include <QElapsedTimer>
+#include <QFileSystemWatcher>
 
 namespace Tor {
 
@@ -54,16 +56,28 @@ public:
     QString errorMessage;
     QHostAddress controlHost;
     quint16 controlPort;
+    QString controlSocketPath;
+    bool unixSockets;
     QByteArray controlPassword;
 
+    /* The control port is found from the "Opened Control listener" log
+     * message, or when the data directory watcher sees the control port
+     * file written. The timer polls for the file as a fallback. */
+    QFileSystemWatcher *controlPortWatcher;
     QTimer controlPortTimer;
-    int controlPortAttempts;
+    QElapsedTimer controlPortElapsed;
 
     TorProcessPrivate(TorProcess *q);
 
     QString torrcPath() const;
     QString controlPortFilePath() const;
+    QString socketPath(const QString &name) const;
     bool ensureFilesExist();
+    bool readControlPortFile();
+    void setControlPort(const QHostAddress &host, quint16 port);
+    void setControlSocketPath(const QString &path);
+    void parseControlListener(const QByteArray &line);
+    void stopControlPortDiscovery();
 
 public slots:
     void processStarted();
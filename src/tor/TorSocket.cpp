@@ -32,6 +32,7 @@
 
 #include "TorSocket.h"
 #include "TorControl.h"
+#include "utils/UnixSocket.h"
 #include <QNetworkProxy>
 
 using namespace Tor;
@@ -39,14 +40,18 @@ using namespace Tor;
 TorSocket::TorSocket(QObject *parent)
     : QTcpSocket(parent)
     , m_port(0)
+    , m_connectTimer(this)
     , m_reconnectEnabled(true)
     , m_maxInterval(900)
     , m_connectAttempts(0)
+    , m_postponeSeconds(0)
+    , m_socksState(SocksInactive)
 {
     connect(torControl, SIGNAL(connectivityChanged()), SLOT(connectivityChanged()));
     connect(&m_connectTimer, SIGNAL(timeout()), SLOT(reconnect()));
     connect(this, SIGNAL(disconnected()), SLOT(onFailed()));
     connect(this, SIGNAL(error(QAbstractSocket::SocketError)), SLOT(onFailed()));
+    connect(this, SIGNAL(readyRead()), SLOT(socksReadable()));
 
     m_connectTimer.setSingleShot(true);
     connectivityChanged();
@@ -84,6 +89,43 @@ void TorSocket::resetAttempts()
     }
 }
 
+void TorSocket::connectNow()
+{
+    m_postponeSeconds = 0;
+    if (state() != QAbstractSocket::UnconnectedState || m_socksState != SocksInactive)
+        return;
+
+    reconnect();
+}
+
+void TorSocket::postponeAttempts(int seconds)
+{
+    if (!m_connectTimer.isActive()) {
+        m_postponeSeconds = seconds;
+        return;
+    }
+
+    m_postponeSeconds = 0;
+    if (m_connectTimer.remainingTime() < seconds * 1000) {
+        m_connectTimer.start(seconds * 1000);
+        qDebug() << "Postponing reconnection of socket to" << m_host << m_port << "for" << seconds << "seconds";
+    }
+}
+
+void TorSocket::setSocksCredentials(const QString &username, const QString &password)
+{
+    m_socksUsername = username;
+    m_socksPassword = password;
+}
+
+QNetworkProxy TorSocket::socksProxy() const
+{
+    QNetworkProxy proxy = torControl->connectionProxy();
+    proxy.setUser(m_socksUsername);
+    proxy.setPassword(m_socksPassword);
+    return proxy;
+}
+
 int TorSocket::reconnectInterval()
 {
     int delay = 0;
@@ -112,9 +154,13 @@ void TorSocket::reconnect()
 void TorSocket::connectivityChanged()
 {
     if (torControl->hasConnectivity()) {
-        setProxy(torControl->connectionProxy());
-        if (state() == QAbstractSocket::UnconnectedState)
+        setProxy(socksProxy());
+        if (state() == QAbstractSocket::UnconnectedState && m_postponeSeconds > 0 && reconnectEnabled()) {
+            m_connectTimer.start(m_postponeSeconds * 1000);
+            m_postponeSeconds = 0;
+        } else if (state() == QAbstractSocket::UnconnectedState) {
             reconnect();
+        }
     } else {
         m_connectTimer.stop();
         m_connectAttempts = 0;
@@ -130,8 +176,14 @@ void TorSocket::connectToHost(const QString &hostName, quint16 port, OpenMode op
     if (!torControl->hasConnectivity())
         return;
 
-    if (proxy() != torControl->connectionProxy())
-        setProxy(torControl->connectionProxy());
+    if (!torControl->socksSocketPath().isEmpty()) {
+        connectThroughSocksPath(torControl->socksSocketPath());
+        return;
+    }
+
+    QNetworkProxy proxy = socksProxy();
+    if (this->proxy() != proxy)
+        setProxy(proxy);
 
     QAbstractSocket::connectToHost(hostName, port, openMode, protocol);
 }
@@ -141,15 +193,155 @@ void TorSocket::connectToHost(const QHostAddress &address, quint16 port, OpenMod
     TorSocket::connectToHost(address.toString(), port, openMode);
 }
 
+void TorSocket::connectThroughSocksPath(const QString &path)
+{
+    if (state() != UnconnectedState)
+        return;
+
+    setProxy(QNetworkProxy::NoProxy);
+
+    QString errorMessage;
+    if (!connectUnixSocket(this, path, &errorMessage)) {
+        qWarning() << "Cannot connect to Tor SOCKS socket:" << errorMessage;
+        setErrorString(errorMessage);
+        setSocketError(ProxyConnectionRefusedError);
+        // Fail from the event loop, as a TCP connection attempt would
+        QMetaObject::invokeMethod(this, "socksPathFailed", Qt::QueuedConnection);
+        return;
+    }
+
+    // Connection uses peerName to know which host this socket reached
+    setPeerName(m_host);
+    setPeerPort(m_port);
+
+    // Version 5, one method: username/password if there are credentials,
+    // otherwise no authentication
+    const char greeting[] = { 0x05, 0x01, char(m_socksUsername.isEmpty() ? 0x00 : 0x02) };
+    m_socksState = SocksAwaitingMethod;
+    write(greeting, sizeof(greeting));
+}
+
+void TorSocket::sendSocksRequest()
+{
+    QByteArray host = m_host.toLatin1();
+    if (host.isEmpty() || host.size() > 255) {
+        socksFailed(HostNotFoundError, QStringLiteral("Invalid hostname for SOCKS connection"));
+        return;
+    }
+
+    QByteArray request;
+    request.reserve(7 + host.size());
+    request.append(char(0x05)).append(char(0x01)).append(char(0x00)).append(char(0x03));
+    request.append(char(host.size())).append(host);
+    request.append(char(m_port >> 8)).append(char(m_port & 0xff));
+
+    m_socksState = SocksAwaitingReply;
+    write(request);
+}
+
+void TorSocket::socksReadable()
+{
+    if (m_socksState == SocksAwaitingMethod) {
+        if (bytesAvailable() < 2)
+            return;
+
+        char reply[2];
+        read(reply, sizeof(reply));
+        char method = m_socksUsername.isEmpty() ? 0x00 : 0x02;
+        if (reply[0] != 0x05 || reply[1] != method) {
+            socksFailed(ProxyProtocolError, QStringLiteral("SOCKS authentication method was refused"));
+            return;
+        }
+
+        if (method == 0x02) {
+            // RFC 1929 username/password subnegotiation
+            QByteArray username = m_socksUsername.toUtf8().left(255);
+            QByteArray password = m_socksPassword.toUtf8().left(255);
+            QByteArray auth;
+            auth.reserve(3 + username.size() + password.size());
+            auth.append(char(0x01));
+            auth.append(char(username.size())).append(username);
+            auth.append(char(password.size())).append(password);
+
+            m_socksState = SocksAwaitingAuth;
+            write(auth);
+        } else {
+            sendSocksRequest();
+        }
+    }
+
+    if (m_socksState == SocksAwaitingAuth) {
+        if (bytesAvailable() < 2)
+            return;
+
+        char reply[2];
+        read(reply, sizeof(reply));
+        if (reply[0] != 0x01 || reply[1] != 0x00) {
+            socksFailed(ProxyAuthenticationRequiredError, QStringLiteral("SOCKS authentication failed"));
+            return;
+        }
+
+        sendSocksRequest();
+    }
+
+    if (m_socksState == SocksAwaitingReply) {
+        // VER REP RSV ATYP, then an address that depends on ATYP, then a port
+        char header[5];
+        if (peek(header, sizeof(header)) < qint64(sizeof(header)))
+            return;
+
+        int addressSize;
+        switch (header[3]) {
+            case 0x01: addressSize = 4; break;
+            case 0x04: addressSize = 16; break;
+            case 0x03: addressSize = 1 + quint8(header[4]); break;
+            default:
+                socksFailed(ProxyProtocolError, QStringLiteral("Invalid SOCKS reply"));
+                return;
+        }
+
+        int replySize = 4 + addressSize + 2;
+        if (bytesAvailable() < replySize)
+            return;
+        read(replySize);
+
+        if (header[0] != 0x05 || header[1] != 0x00) {
+            // Tor uses the reply code to describe why an onion service connection failed
+            socksFailed(ProxyConnectionRefusedError,
+                        QStringLiteral("SOCKS connection failed with reply %1").arg(int(quint8(header[1]))));
+            return;
+        }
+
+        m_socksState = SocksInactive;
+        emit connected();
+    }
+}
+
+void TorSocket::socksPathFailed()
+{
+    emit error(ProxyConnectionRefusedError);
+}
+
+void TorSocket::socksFailed(SocketError error, const QString &message)
+{
+    m_socksState = SocksInactive;
+    setErrorString(message);
+    setSocketError(error);
+    emit this->error(error);
+}
+
 void TorSocket::onFailed()
 {
+    m_socksState = SocksInactive;
+
     // Make sure the internal connection to the SOCKS proxy is closed
     // Otherwise reconnect attempts will fail (#295)
     close();
 
     if (reconnectEnabled() && !m_connectTimer.isActive()) {
         m_connectAttempts++;
-        m_connectTimer.start(reconnectInterval() * 1000);
+        m_connectTimer.start(qMax(reconnectInterval(), m_postponeSeconds) * 1000);
+        m_postponeSeconds = 0;
         qDebug() << "Reconnecting socket to" << m_host << m_port << "in" << m_connectTimer.interval() / 1000 << "seconds";
     }
 }
@@ -35,6 +35,7 @@
 
 #include <QTcpSocket>
 #include <QTimer>
+#include <QNetworkProxy>
 
 namespace Tor {
 
@@ -52,6 +53,9 @@ namespace Tor {
  *
  * The caller is responsible for resetting the attempt counter if a
  * connection was successful and reconnection will be used again.
+ *
+ * Tor isolates streams by SOCKS credentials, so sockets with different
+ * credentials (see setSocksCredentials) never share a circuit.
  */
 class TorSocket : public QTcpSocket
 {
@@ -66,6 +70,17 @@ public:
     int maxAttemptInterval() { return m_maxInterval; }
     void setMaxAttemptInterval(int interval);
     void resetAttempts();
+    /* Attempt a connection now instead of waiting for the reconnect
+     * interval, if the socket is idle. */
+    void connectNow();
+    /* Wait at least 'seconds' before the next attempt, e.g. when the peer is
+     * known to be unreachable. An attempt in progress is not interrupted;
+     * the delay applies after it fails. connectNow cancels it. */
+    void postponeAttempts(int seconds);
+
+    /* Username and password for SOCKS authentication, used by Tor only to
+     * isolate streams. They apply from the next connection attempt. */
+    void setSocksCredentials(const QString &username, const QString &password);
 
     virtual void connectToHost(const QString &hostName, quint16 port, OpenMode openMode = ReadWrite, NetworkLayerProtocol protocol = AnyIPProtocol);
     virtual void connectToHost(const QHostAddress &address, quint16 port, OpenMode openMode = ReadWrite);
@@ -80,6 +95,8 @@ private slots:
     void reconnect();
     void connectivityChanged();
     void onFailed();
+    void socksReadable();
+    void socksPathFailed();
 
 private:
     QString m_host;
@@ -88,6 +105,25 @@ private:
     bool m_reconnectEnabled;
     int m_maxInterval;
     int m_connectAttempts;
+    int m_postponeSeconds;
+
+    /* SOCKS5 negotiation over Tor's unix SOCKS socket, which QNetworkProxy
+     * can't use. connected() is emitted once the stream is established. */
+    enum SocksState {
+        SocksInactive,
+        SocksAwaitingMethod,
+        SocksAwaitingAuth,
+        SocksAwaitingReply
+    };
+    SocksState m_socksState;
+    QString m_socksUsername;
+    QString m_socksPassword;
+
+    QNetworkProxy socksProxy() const;
+    void sendSocksRequest();
+
+    void connectThroughSocksPath(const QString &path);
+    void socksFailed(SocketError error, const QString &message);
 
     using QAbstractSocket::connectToHost;
 };
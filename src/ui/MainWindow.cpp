@@ -40,6 +40,7 @@
 #include "tor/TorControl.h"
 #include "tor/TorManager.h"
 #include "tor/TorProcess.h"
+#include "tor/TorLog.h"
 #include "ContactsModel.h"
 #include "ui/LinkedText.h"
 #include "utils/Settings.h"
@@ -119,6 +120,7 @@ MainWindow::MainWindow(QObject *parent)
     qmlRegisterUncreatableType<OutgoingContactRequest>("im.ricochet", 1, 0, "OutgoingContactRequest", QString());
     qmlRegisterUncreatableType<Tor::TorControl>("im.ricochet", 1, 0, "TorControl", QString());
     qmlRegisterUncreatableType<Tor::TorProcess>("im.ricochet", 1, 0, "TorProcess", QString());
+    qmlRegisterUncreatableType<Tor::TorLog>("im.ricochet", 1, 0, "TorLog", QString());
     qmlRegisterType<ConversationModel>("im.ricochet", 1, 0, "ConversationModel");
     qmlRegisterType<ContactsModel>("im.ricochet", 1, 0, "ContactsModel");
     qmlRegisterType<ContactIDValidator>("im.ricochet", 1, 0, "ContactIDValidator");
@@ -4,7 +4,7 @@ import QtMultimedia 5.0
 QtObject {
     id: audioNotifications
 
-    property real volume: uiSettings.data.notificationVolume
+    property real volume: uiSettings.values.notificationVolume
 
     property SoundEffect message: SoundEffect {
         source: "qrc:/sounds/message.wav"
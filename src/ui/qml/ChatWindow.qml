@@ -19,7 +19,7 @@ ApplicationWindow {
 
     onClosed: {
         // If not also in combined window mode, clear chat history when closing
-        if (!uiSettings.data.combinedChatWindow)
+        if (!uiSettings.values.combinedChatWindow)
             chatPage.conversationModel.clear()
     }
 
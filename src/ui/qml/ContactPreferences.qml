@@ -109,7 +109,7 @@ Item {
                     Layout.fillWidth: true
                     elide: Text.ElideRight
                     visible: contactInfo.request === null
-                    text: visible ? Qt.formatDate(contactInfo.contact.settings.read("lastConnected"), Qt.DefaultLocaleLongDate) : ""
+                    text: visible ? Qt.formatDate(contactInfo.contact.state.read("lastConnected"), Qt.DefaultLocaleLongDate) : ""
                     textFormat: Text.PlainText
                 }
 
@@ -10,7 +10,7 @@ ColumnLayout {
 
     CheckBox {
         text: qsTr("Use a single window for conversations")
-        checked: uiSettings.data.combinedChatWindow || false
+        checked: uiSettings.values.combinedChatWindow || false
         onCheckedChanged: {
             uiSettings.write("combinedChatWindow", checked)
         }
@@ -18,7 +18,7 @@ ColumnLayout {
 
     CheckBox {
         text: qsTr("Open links in default browser without prompting")
-        checked: uiSettings.data.alwaysOpenBrowser || false
+        checked: uiSettings.values.alwaysOpenBrowser || false
         onCheckedChanged: {
             uiSettings.write("alwaysOpenBrowser", checked)
         }
@@ -26,7 +26,7 @@ ColumnLayout {
 
     CheckBox {
         text: qsTr("Play audio notifications")
-        checked: uiSettings.data.playAudioNotification || false
+        checked: uiSettings.values.playAudioNotification || false
         onCheckedChanged: {
             uiSettings.write("playAudioNotification", checked)
         }
@@ -39,7 +39,7 @@ ColumnLayout {
         Slider {
             maximumValue: 1.0
             updateValueWhileDragging: false
-            enabled: uiSettings.data.playAudioNotification || false
+            enabled: uiSettings.values.playAudioNotification || false
             value: uiSettings.read("notificationVolume", 0.75)
             onValueChanged: {
                 uiSettings.write("notificationVolume", value)
@@ -9,7 +9,7 @@ ColumnLayout {
         margins: 8
     }
 
-    property string previousLanguage: uiSettings.data.language
+    property string previousLanguage: uiSettings.values.language
 
     ExclusiveGroup {
         id: languageGroup
@@ -33,7 +33,7 @@ ColumnLayout {
                 id: languageSelection
                 Layout.fillWidth: true
                 text: nativeName
-                checked: localeID === uiSettings.data.language
+                checked: localeID === uiSettings.values.language
                 exclusiveGroup: languageGroup
                 onCheckedChanged: {
                     if (checked && previousLanguage !== localeID) {
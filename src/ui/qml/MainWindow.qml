@@ -13,8 +13,8 @@ ApplicationWindow {
     width: 250
     height: 400
     minimumHeight: 400
-    minimumWidth: uiSettings.data.combinedChatWindow ? 650 : 250
-    maximumWidth: uiSettings.data.combinedChatWindow ? (1 << 24) - 1 : 250
+    minimumWidth: uiSettings.values.combinedChatWindow ? 650 : 250
+    maximumWidth: uiSettings.values.combinedChatWindow ? (1 << 24) - 1 : 250
 
     onMinimumWidthChanged: width = Math.max(width, minimumWidth)
     onMaximumWidthChanged: width = Math.min(width, maximumWidth)
@@ -40,7 +40,7 @@ ApplicationWindow {
                 if (audioNotifications !== null)
                     audioNotifications.message.play()
                 var w = window
-                if (!uiSettings.data.combinedChatWindow || ContactWindow.windowExists(user))
+                if (!uiSettings.values.combinedChatWindow || ContactWindow.windowExists(user))
                     w = ContactWindow.getWindow(user)
                 // On OS X, avoid bouncing the dock icon forever
                 w.alert(Qt.platform.os == "osx" ? 1000 : 0)
@@ -80,7 +80,7 @@ ApplicationWindow {
                     onContactActivated: {
                         if (contact.status === ContactUser.RequestPending || contact.status === ContactUser.RequestRejected) {
                             actions.openPreferences()
-                        } else if (!uiSettings.data.combinedChatWindow) {
+                        } else if (!uiSettings.values.combinedChatWindow) {
                             actions.openWindow()
                         }
                     }
@@ -104,7 +104,7 @@ ApplicationWindow {
 
         PageView {
             id: combinedChatView
-            visible: uiSettings.data.combinedChatWindow || false
+            visible: uiSettings.values.combinedChatWindow || false
             Layout.fillWidth: true
             Layout.fillHeight: true
 
@@ -140,7 +140,7 @@ Column {
                 text: qsTr("Open with Browser")
                 visible: hoveredLink.length > 0 && hoveredLink.substr(0,4).toLowerCase() == "http"
                 onTriggered: {
-                    if (uiSettings.data.alwaysOpenBrowser || contact.settings.data.alwaysOpenBrowser) {
+                    if (uiSettings.values.alwaysOpenBrowser || contact.settings.values.alwaysOpenBrowser) {
                         Qt.openUrlExternally(hoveredLink)
                     } else {
                         var window = uiMain.findParentWindow(delegate)
@@ -57,13 +57,13 @@ ApplicationWindow {
         CheckBox {
             id: alwaysOpenContact
             text: qsTr("Don't ask again for links from %1").arg(contact ? Utils.htmlEscaped(contact.nickname) : "???")
-            checked: contact.settings.data.alwaysOpenBrowser || false
+            checked: contact.settings.values.alwaysOpenBrowser || false
         }
 
         CheckBox {
             id: alwaysOpenAll
             text: qsTr("Don't ask again for any links (not recommended!)")
-            checked: uiSettings.data.alwaysOpenBrowser || false
+            checked: uiSettings.values.alwaysOpenBrowser || false
         }
 
         RowLayout {
@@ -5,13 +5,15 @@ import QtQuick.Layouts 1.0
 TextArea {
     id: logDisplay
     readOnly: true
-    text: torInstance.logMessages.join('\n')
     textFormat: TextEdit.PlainText
     wrapMode: TextEdit.Wrap
 
+    // Filled once, then appended to, so new lines don't reset scrolling or selection
+    Component.onCompleted: text = torInstance.log.messages.join('\n')
+
     Connections {
-        target: torInstance.process
-        onLogMessage: {
+        target: torInstance.log
+        onMessageAdded: {
             logDisplay.append(message)
         }
     }
@@ -135,7 +135,7 @@ QtObject {
 
         Loader {
             id: audioNotificationLoader
-            active: uiSettings.data.playAudioNotification || false
+            active: uiSettings.values.playAudioNotification || false
             source: "AudioNotifications.qml"
         }
     ]
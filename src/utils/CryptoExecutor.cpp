@@ -0,0 +1,98 @@
+/* Ricochet - https://ricochet.im/
+ * Copyright (C) 2014, John Brooks <john.brooks@dereferenced.net>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *    * Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following disclaimer
+ *      in the documentation and/or other materials provided with the
+ *      distribution.
+ *
+ *    * Neither the names of the copyright owners nor the names of its
+ *      contributors may be used to endorse or promote products derived from
+ *      this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "CryptoExecutor.h"
+#include <QThreadPool>
+#include <QThread>
+#include <QMutex>
+#include <QDebug>
+#include <openssl/crypto.h>
+
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+static QMutex *opensslLocks = 0;
+
+static void opensslLockingCallback(int mode, int type, const char *file, int line)
+{
+    Q_UNUSED(file);
+    Q_UNUSED(line);
+
+    if (mode & CRYPTO_LOCK)
+        opensslLocks[type].lock();
+    else
+        opensslLocks[type].unlock();
+}
+
+#if OPENSSL_VERSION_NUMBER >= 0x10000000L
+static void opensslThreadIdCallback(CRYPTO_THREADID *id)
+{
+    CRYPTO_THREADID_set_pointer(id, QThread::currentThreadId());
+}
+#else
+static unsigned long opensslThreadIdCallback()
+{
+    return reinterpret_cast<unsigned long>(QThread::currentThreadId());
+}
+#endif
+#endif
+
+void CryptoExecutor::initializeThreading()
+{
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+    if (CRYPTO_get_locking_callback()) {
+        qDebug() << "OpenSSL locking callbacks are already installed";
+        return;
+    }
+
+    opensslLocks = new QMutex[CRYPTO_num_locks()];
+#if OPENSSL_VERSION_NUMBER >= 0x10000000L
+    CRYPTO_THREADID_set_callback(opensslThreadIdCallback);
+#else
+    CRYPTO_set_id_callback(opensslThreadIdCallback);
+#endif
+    CRYPTO_set_locking_callback(opensslLockingCallback);
+#endif
+}
+
+static QThreadPool *createThreadPool()
+{
+    QThreadPool *pool = new QThreadPool;
+    // Keep a core free for the UI and network threads
+    pool->setMaxThreadCount(qMax(1, QThread::idealThreadCount() - 1));
+    pool->setExpiryTimeout(60000);
+    return pool;
+}
+
+QThreadPool *CryptoExecutor::threadPool()
+{
+    static QThreadPool *pool = createThreadPool();
+    return pool;
+}
@@ -0,0 +1,118 @@
+/* Ricochet - https://ricochet.im/
+ * Copyright (C) 2014, John Brooks <john.brooks@dereferenced.net>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *    * Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following disclaimer
+ *      in the documentation and/or other materials provided with the
+ *      distribution.
+ *
+ *    * Neither the names of the copyright owners nor the names of its
+ *      contributors may be used to endorse or promote products derived from
+ *      this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef CRYPTOEXECUTOR_H
+#define CRYPTOEXECUTOR_H
+
+#include <QObject>
+#include <QRunnable>
+#include <QSharedPointer>
+#include <functional>
+
+class QThreadPool;
+
+/* Runs expensive cryptographic operations off the calling thread
+ *
+ * RSA signing and verification take long enough that doing many of them
+ * at once (authenticating to every contact at startup, or a flood of
+ * inbound connections) would stall the UI. CryptoExecutor::run executes
+ * 'work' on a shared thread pool, then calls 'done' with its result on the
+ * thread of 'context'.
+ *
+ * If 'context' is destroyed before the work finishes, 'done' is never
+ * called. 'work' must not touch 'context' or any other object that isn't
+ * safe to use from another thread; capture values instead.
+ */
+class CryptoExecutor
+{
+public:
+    /* Install OpenSSL's locking and thread ID callbacks, which versions
+     * before 1.1 need to be used from more than one thread. Call once at
+     * startup, before any work is run. */
+    static void initializeThreading();
+
+    static QThreadPool *threadPool();
+
+    template<typename Work, typename Done>
+    static void run(QObject *context, Work work, Done done);
+};
+
+class CryptoTaskNotifier : public QObject
+{
+    Q_OBJECT
+
+signals:
+    void finished();
+};
+
+class CryptoTask : public QRunnable
+{
+public:
+    explicit CryptoTask(const std::function<void()> &function)
+        : m_function(function)
+    {
+    }
+
+    virtual void run()
+    {
+        m_function();
+    }
+
+private:
+    std::function<void()> m_function;
+};
+
+template<typename Work, typename Done>
+void CryptoExecutor::run(QObject *context, Work work, Done done)
+{
+    typedef decltype(work()) Result;
+    QSharedPointer<Result> result(new Result);
+
+    // The notifier lives on the context's thread, so finished() is queued there
+    CryptoTaskNotifier *notifier = new CryptoTaskNotifier;
+    notifier->moveToThread(context->thread());
+    QObject::connect(notifier, &CryptoTaskNotifier::finished, context,
+        [result,done]() {
+            done(*result);
+        }
+    );
+
+    threadPool()->start(new CryptoTask(
+        [notifier,result,work]() {
+            *result = work();
+            emit notifier->finished();
+            notifier->deleteLater();
+        }
+    ));
+}
+
+#endif // CRYPTOEXECUTOR_H
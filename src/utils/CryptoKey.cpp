@@ -31,15 +31,21 @@
  */
 
 #include "CryptoKey.h"
+#include "OnionAddress.h"
 #include "SecureRNG.h"
 #include "Useful.h"
 #include <QtDebug>
 #include <QFile>
+#include <QCache>
 #include <openssl/bio.h>
 #include <openssl/pem.h>
 
-void base32_encode(char *dest, unsigned destlen, const char *src, unsigned srclen);
-bool base32_decode(char *dest, unsigned destlen, const char *src, unsigned srclen);
+static QByteArray encodePublicKey(RSA *key, CryptoKey::KeyFormat format);
+
+// Bounded map of DER-encoded public keys to service IDs, for cachedServiceID
+static const int serviceIDCacheSize = 1024;
+static QMutex serviceIDCacheMutex;
+static QCache<QByteArray,QString> serviceIDCache(serviceIDCacheSize);
 
 CryptoKey::CryptoKey()
 {
@@ -67,6 +73,7 @@ void CryptoKey::clear()
 bool CryptoKey::loadFromData(const QByteArray &data, KeyType type, KeyFormat format)
 {
     RSA *key = NULL;
+    const uchar *dp = reinterpret_cast<const uchar*>(data.constData());
     clear();
 
     if (data.isEmpty())
@@ -82,13 +89,10 @@ bool CryptoKey::loadFromData(const QByteArray &data, KeyType type, KeyFormat for
 
         BIO_free(b);
     } else if (format == DER) {
-        const uchar *dp = reinterpret_cast<const uchar*>(data.constData());
-        if (type == PrivateKey) {
-            BUG() << "Parsing DER-encoded private keys is not implemented";
-            return false;
-        }
-
-        key = d2i_RSAPublicKey(NULL, &dp, data.size());
+        if (type == PrivateKey)
+            key = d2i_RSAPrivateKey(NULL, &dp, data.size());
+        else
+            key = d2i_RSAPublicKey(NULL, &dp, data.size());
     } else {
         Q_UNREACHABLE();
     }
@@ -98,6 +102,8 @@ bool CryptoKey::loadFromData(const QByteArray &data, KeyType type, KeyFormat for
         return false;
     }
 
+    // The input isn't reused as the DER encoding: a peer could send any of several BER
+    // encodings of one key, and the digest and service ID must only depend on the key.
     d = new Data(key);
     return true;
 }
@@ -118,6 +124,24 @@ bool CryptoKey::loadFromFile(const QString &path, KeyType type, KeyFormat format
     return loadFromData(data, type, format);
 }
 
+bool CryptoKey::generateNew(int bits)
+{
+    clear();
+
+    RSA *key = RSA_new();
+    BIGNUM *e = BN_new();
+    if (!key || !e || !BN_set_word(e, RSA_F4) || !RSA_generate_key_ex(key, bits, e, NULL)) {
+        qWarning() << "Failed to generate a new" << bits << "bit RSA key";
+        BN_free(e);
+        RSA_free(key);
+        return false;
+    }
+
+    BN_free(e);
+    d = new Data(key);
+    return true;
+}
+
 bool CryptoKey::isPrivate() const
 {
     return isLoaded() && d->key->p != 0;
@@ -135,6 +159,10 @@ QByteArray CryptoKey::publicKeyDigest() const
 
     QByteArray buf = encodedPublicKey(DER);
 
+    QMutexLocker locker(&d->cacheMutex);
+    if (!d->digest.isNull())
+        return d->digest;
+
     QByteArray re(20, 0);
     bool ok = SHA1(reinterpret_cast<const unsigned char*>(buf.constData()), buf.size(),
          reinterpret_cast<unsigned char*>(re.data())) != NULL;
@@ -145,6 +173,7 @@ QByteArray CryptoKey::publicKeyDigest() const
         return QByteArray();
     }
 
+    d->digest = re;
     return re;
 }
 
@@ -153,10 +182,59 @@ QByteArray CryptoKey::encodedPublicKey(KeyFormat format) const
     if (!isLoaded())
         return QByteArray();
 
+    QMutexLocker locker(&d->cacheMutex);
+    QByteArray &cached = (format == PEM) ? d->pemPublicKey : d->derPublicKey;
+    if (cached.isNull())
+        cached = encodePublicKey(d->key, format);
+    return cached;
+}
+
+QByteArray CryptoKey::encodedPrivateKey(KeyFormat format) const
+{
+    if (!isPrivate())
+        return QByteArray();
+
     if (format == PEM) {
         BIO *b = BIO_new(BIO_s_mem());
 
-        if (!PEM_write_bio_RSAPublicKey(b, d->key)) {
+        if (!PEM_write_bio_RSAPrivateKey(b, d->key, NULL, NULL, 0, NULL, NULL)) {
+            BUG() << "Failed to encode private key in PEM format";
+            BIO_free(b);
+            return QByteArray();
+        }
+
+        BUF_MEM *buf;
+        BIO_get_mem_ptr(b, &buf);
+
+        QByteArray re((const char *)buf->data, (int)buf->length);
+        OPENSSL_cleanse(buf->data, buf->length);
+        BIO_free(b);
+        return re;
+    } else if (format == DER) {
+        uchar *buf = NULL;
+        int len = i2d_RSAPrivateKey(d->key, &buf);
+        if (len <= 0 || !buf) {
+            BUG() << "Failed to encode private key in DER format";
+            return QByteArray();
+        }
+
+        QByteArray re((const char*)buf, len);
+        OPENSSL_cleanse(buf, len);
+        OPENSSL_free(buf);
+        return re;
+    } else {
+        Q_UNREACHABLE();
+    }
+
+    return QByteArray();
+}
+
+static QByteArray encodePublicKey(RSA *key, CryptoKey::KeyFormat format)
+{
+    if (format == CryptoKey::PEM) {
+        BIO *b = BIO_new(BIO_s_mem());
+
+        if (!PEM_write_bio_RSAPublicKey(b, key)) {
             BUG() << "Failed to encode public key in PEM format";
             BIO_free(b);
             return QByteArray();
@@ -172,9 +250,9 @@ QByteArray CryptoKey::encodedPublicKey(KeyFormat format) const
         QByteArray re((const char *)buf->data, (int)buf->length);
         BUF_MEM_free(buf);
         return re;
-    } else if (format == DER) {
+    } else if (format == CryptoKey::DER) {
         uchar *buf = NULL;
-        int len = i2d_RSAPublicKey(d->key, &buf);
+        int len = i2d_RSAPublicKey(key, &buf);
         if (len <= 0 || !buf) {
             BUG() << "Failed to encode public key in DER format";
             return QByteArray();
@@ -195,20 +273,36 @@ QString CryptoKey::torServiceID() const
     if (!isLoaded())
         return QString();
 
+    {
+        QMutexLocker locker(&d->cacheMutex);
+        if (!d->serviceID.isNull())
+            return d->serviceID;
+    }
+
     QByteArray digest = publicKeyDigest();
     if (digest.isNull())
         return QString();
 
-    static const int hostnameDigestSize = 10;
-    static const int hostnameEncodedSize = 16;
+    QString serviceID = OnionAddress::fromDigest(digest).serviceID();
+    {
+        QMutexLocker locker(&d->cacheMutex);
+        d->serviceID = serviceID;
+    }
 
-    QByteArray re(hostnameEncodedSize+1, 0);
-    base32_encode(re.data(), re.size(), digest.constData(), hostnameDigestSize);
+    QByteArray encoded = encodedPublicKey(DER);
+    if (!encoded.isEmpty()) {
+        QMutexLocker locker(&serviceIDCacheMutex);
+        serviceIDCache.insert(encoded, new QString(serviceID));
+    }
 
-    // Chop extra null byte
-    re.chop(1);
+    return serviceID;
+}
 
-    return QString::fromLatin1(re);
+QString CryptoKey::cachedServiceID(const QByteArray &encodedPublicKey)
+{
+    QMutexLocker locker(&serviceIDCacheMutex);
+    QString *serviceID = serviceIDCache.object(encodedPublicKey);
+    return serviceID ? *serviceID : QString();
 }
 
 QByteArray CryptoKey::signData(const QByteArray &data) const
@@ -296,125 +390,3 @@ QByteArray torControlHashedPassword(const QByteArray &password)
     return QByteArray("16:") + salt.toHex().toUpper() + QByteArray("60") +
            QByteArray::fromRawData(reinterpret_cast<const char*>(md), 20).toHex().toUpper();
 }
-
-/* Copyright (c) 2001-2004, Roger Dingledine
- * Copyright (c) 2004-2006, Roger Dingledine, Nick Mathewson
- * Copyright (c) 2007-2010, The Tor Project, Inc.
- *
- * Redistribution and use in source and binary forms, with or without
- * modification, are permitted provided that the following conditions are
- * met:
- *
- *   Redistributions of source code must retain the above copyright
- *   notice, this list of conditions and the following disclaimer.
- *
- *   Redistributions in binary form must reproduce the above
- *   copyright notice, this list of conditions and the following disclaimer
- *   in the documentation and/or other materials provided with the
- *   distribution.
- *
- *   Neither the names of the copyright owners nor the names of its
- *   contributors may be used to endorse or promote products derived from
- *   this software without specific prior written permission.
- *
- * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
- * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
- * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
- * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
- * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
- * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
- * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
- * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
- * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
- * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
- * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
- */
-
-#define BASE32_CHARS "abcdefghijklmnopqrstuvwxyz234567"
-
-/* Implements base32 encoding as in rfc3548. Requires that srclen*8 is a multiple of 5. */
-void base32_encode(char *dest, unsigned destlen, const char *src, unsigned srclen)
-{
-    unsigned i, bit, v, u;
-    unsigned nbits = srclen * 8;
-
-     /* We need an even multiple of 5 bits, and enough space */
-    if ((nbits%5) != 0 || destlen > (nbits/5)+1) {
-        Q_ASSERT(false);
-        memset(dest, 0, destlen);
-        return;
-    }
-
-    for (i = 0, bit = 0; bit < nbits; ++i, bit += 5)
-    {
-        /* set v to the 16-bit value starting at src[bits/8], 0-padded. */
-        v = ((quint8) src[bit / 8]) << 8;
-        if (bit + 5 < nbits)
-            v += (quint8) src[(bit/8)+1];
-
-        /* set u to the 5-bit value at the bit'th bit of src. */
-        u = (v >> (11 - (bit % 8))) & 0x1F;
-        dest[i] = BASE32_CHARS[u];
-    }
-
-    dest[i] = '\0';
-}
-
-/* Implements base32 decoding as in rfc3548. Requires that srclen*5 is a multiple of 8. */
-bool base32_decode(char *dest, unsigned destlen, const char *src, unsigned srclen)
-{
-    unsigned int i, j, bit;
-    unsigned nbits = srclen * 5;
-
-     /* We need an even multiple of 8 bits, and enough space */
-    if ((nbits%8) != 0 || (nbits/8)+1 > destlen) {
-        Q_ASSERT(false);
-        return false;
-    }
-
-    char *tmp = new char[srclen];
-
-    /* Convert base32 encoded chars to the 5-bit values that they represent. */
-    for (j = 0; j < srclen; ++j)
-    {
-        if (src[j] > 0x60 && src[j] < 0x7B)
-            tmp[j] = src[j] - 0x61;
-        else if (src[j] > 0x31 && src[j] < 0x38)
-            tmp[j] = src[j] - 0x18;
-        else if (src[j] > 0x40 && src[j] < 0x5B)
-            tmp[j] = src[j] - 0x41;
-        else
-        {
-            delete[] tmp;
-            return false;
-        }
-    }
-
-    /* Assemble result byte-wise by applying five possible cases. */
-    for (i = 0, bit = 0; bit < nbits; ++i, bit += 8)
-    {
-        switch (bit % 40)
-        {
-        case 0:
-            dest[i] = (((quint8)tmp[(bit/5)]) << 3) + (((quint8)tmp[(bit/5)+1]) >> 2);
-            break;
-        case 8:
-            dest[i] = (((quint8)tmp[(bit/5)]) << 6) + (((quint8)tmp[(bit/5)+1]) << 1)
-                      + (((quint8)tmp[(bit/5)+2]) >> 4);
-            break;
-        case 16:
-            dest[i] = (((quint8)tmp[(bit/5)]) << 4) + (((quint8)tmp[(bit/5)+1]) >> 1);
-            break;
-        case 24:
-            dest[i] = (((quint8)tmp[(bit/5)]) << 7) + (((quint8)tmp[(bit/5)+1]) << 2)
-                      + (((quint8)tmp[(bit/5)+2]) >> 3);
-            break;
-        case 32:
-            dest[i] = (((quint8)tmp[(bit/5)]) << 5) + ((quint8)tmp[(bit/5)+1]);
-            break;
-        }
-    }
-
-    delete[] tmp;
-    return true;
-}
@@ -36,6 +36,7 @@
 #include <QString>
 #include <QSharedData>
 #include <QExplicitlySharedDataPointer>
+#include <QMutex>
 
 class CryptoKey
 {
@@ -56,6 +57,8 @@ public:
 
     bool loadFromData(const QByteArray &data, KeyType type, KeyFormat format = PEM);
     bool loadFromFile(const QString &path, KeyType type, KeyFormat format = PEM);
+    // Generate a new private key, as used for onion services
+    bool generateNew(int bits = 1024);
     void clear();
 
     bool isLoaded() const { return d.data() && d->key != 0; }
@@ -63,9 +66,20 @@ public:
 
     QByteArray publicKeyDigest() const;
     QByteArray encodedPublicKey(KeyFormat format = PEM) const;
+    QByteArray encodedPrivateKey(KeyFormat format = PEM) const;
     QString torServiceID() const;
     int bits() const;
 
+    /* Service ID of a DER-encoded public key, if a key with exactly that
+     * encoding (as returned by encodedPublicKey(DER)) has calculated its
+     * torServiceID recently. Returns a null string otherwise. The cache is
+     * bounded and shared between threads.
+     *
+     * This is not proof that the peer holds the private key; it only
+     * avoids parsing and hashing keys that have been seen before.
+     */
+    static QString cachedServiceID(const QByteArray &encodedPublicKey);
+
     // Calculate and sign SHA-256 digest of data using this key and PKCS #1 v2.0 padding
     QByteArray signData(const QByteArray &data) const;
     // Verify a signature as per signData
@@ -82,6 +96,13 @@ private:
         typedef struct rsa_st RSA;
         RSA *key;
 
+        // Encodings of the public key, calculated on first use
+        QMutex cacheMutex;
+        QByteArray pemPublicKey;
+        QByteArray derPublicKey;
+        QByteArray digest;
+        QString serviceID;
+
         Data(RSA *k = 0) : key(k) { }
         ~Data();
     };
@@ -0,0 +1,133 @@
+/* Ricochet - https://ricochet.im/
+ * Copyright (C) 2014, John Brooks <john.brooks@dereferenced.net>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *    * Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following disclaimer
+ *      in the documentation and/or other materials provided with the
+ *      distribution.
+ *
+ *    * Neither the names of the copyright owners nor the names of its
+ *      contributors may be used to endorse or promote products derived from
+ *      this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "LegacySettings.h"
+#include "Settings.h"
+#include "OnionAddress.h"
+#include <QSettings>
+#include <QDateTime>
+#include <QStringList>
+#include <QDebug>
+
+static void copyKeys(QSettings &old, SettingsObject *object)
+{
+    foreach (const QString &key, old.childKeys()) {
+        QVariant value = old.value(key);
+        if ((QMetaType::Type)value.type() == QMetaType::QDateTime)
+            object->write(key, value.toDateTime());
+        else if ((QMetaType::Type)value.type() == QMetaType::QByteArray)
+            object->write(key, Base64Encode(value.toByteArray()));
+        else
+            object->write(key, value.toString());
+    }
+}
+
+bool importLegacySettings(SettingsFile *settings, const QString &oldPath)
+{
+    QSettings old(oldPath, QSettings::IniFormat);
+    SettingsObject *root = settings->root();
+    SettingsTransaction transaction(settings);
+    QVariant value;
+
+    qDebug() << "Importing legacy format settings from" << oldPath;
+
+    if (!(value = old.value(QStringLiteral("tor/controlIp"))).isNull())
+        root->write("tor.controlAddress", value.toString());
+    if (!(value = old.value(QStringLiteral("tor/controlPort"))).isNull())
+        root->write("tor.controlPort", value.toInt());
+    if (!(value = old.value(QStringLiteral("tor/authPassword"))).isNull())
+        root->write("tor.controlPassword", value.toString());
+    if (!(value = old.value(QStringLiteral("tor/socksIp"))).isNull())
+        root->write("tor.socksAddress", value.toString());
+    if (!(value = old.value(QStringLiteral("tor/socksPort"))).isNull())
+        root->write("tor.socksPort", value.toInt());
+    if (!(value = old.value(QStringLiteral("tor/executablePath"))).isNull())
+        root->write("tor.executablePath", value.toString());
+    if (!(value = old.value(QStringLiteral("core/neverPublishService"))).isNull())
+        root->write("tor.neverPublishServices", value.toBool());
+    if (!(value = old.value(QStringLiteral("identity/0/dataDirectory"))).isNull())
+        root->write("identity.dataDirectory", value.toString());
+    if (!(value = old.value(QStringLiteral("identity/0/createNewService"))).isNull())
+        root->write("identity.initializing", value.toBool());
+    if (!(value = old.value(QStringLiteral("core/listenIp"))).isNull())
+        root->write("identity.localListenAddress", value.toString());
+    if (!(value = old.value(QStringLiteral("core/listenPort"))).isNull())
+        root->write("identity.localListenPort", value.toInt());
+
+    {
+        old.beginGroup(QStringLiteral("contacts"));
+        QStringList ids = old.childGroups();
+        foreach (const QString &id, ids) {
+            old.beginGroup(id);
+            SettingsObject userObject(root, QStringLiteral("contacts.%1").arg(id));
+
+            copyKeys(old, &userObject);
+
+            if (old.childGroups().contains(QStringLiteral("request"))) {
+                old.beginGroup(QStringLiteral("request"));
+                QStringList requestKeys = old.childKeys();
+                foreach (const QString &key, requestKeys)
+                    userObject.write(QStringLiteral("request.") + key, old.value(key).toString());
+                old.endGroup();
+            }
+
+            old.endGroup();
+        }
+        old.endGroup();
+    }
+
+    {
+        old.beginGroup(QStringLiteral("contactRequests"));
+        QStringList contacts = old.childGroups();
+
+        foreach (const QString &hostname, contacts) {
+            old.beginGroup(hostname);
+            SettingsObject requestObject(root, QStringLiteral("contactRequests.%1").arg(hostname));
+            copyKeys(old, &requestObject);
+            old.endGroup();
+        }
+
+        old.endGroup();
+    }
+
+    if (!(value = old.value(QStringLiteral("core/hostnameBlacklist"))).isNull()) {
+        // The original rejection times weren't kept; use the time of import
+        QDateTime now = QDateTime::currentDateTime();
+        foreach (const QString &hostname, value.toStringList()) {
+            OnionAddress address = OnionAddress::fromString(hostname);
+            if (address.isValid())
+                root->write(QStringLiteral("identity.rejectedHostnames.") + address.serviceID(), now);
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,216 @@
+/* Ricochet - https://ricochet.im/
+ * Copyright (C) 2014, John Brooks <john.brooks@dereferenced.net>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *    * Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following disclaimer
+ *      in the documentation and/or other materials provided with the
+ *      distribution.
+ *
+ *    * Neither the names of the copyright owners nor the names of its
+ *      contributors may be used to endorse or promote products derived from
+ *      this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "OnionAddress.h"
+
+static const char base32Alphabet[] = "abcdefghijklmnopqrstuvwxyz234567";
+
+// Value of each base32 character in either case, or 0xff if invalid
+static const quint8 base32Values[256] = {
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e,
+    0x0f, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e,
+    0x0f, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff
+};
+
+static inline quint8 base32Value(uint c)
+{
+    return c < 256 ? base32Values[c] : 0xff;
+}
+
+template<typename T> static inline bool equalsLowered(const T *data, const char *latin1, int size)
+{
+    for (int i = 0; i < size; i++) {
+        uint c = data[i];
+        if (c >= 'A' && c <= 'Z')
+            c += 'a' - 'A';
+        if (c != latin1[i])
+            return false;
+    }
+    return true;
+}
+
+template<typename T> OnionAddress OnionAddress::parse(const T *data, int size)
+{
+    static const char suffix[] = ".onion";
+    static const int suffixSize = sizeof(suffix) - 1;
+    static const char *prefixes[] = { "ricochet:", "torsion:" };
+
+    OnionAddress re;
+
+    for (unsigned i = 0; i < sizeof(prefixes) / sizeof(*prefixes); i++) {
+        int prefixSize = int(strlen(prefixes[i]));
+        if (size > prefixSize && equalsLowered(data, prefixes[i], prefixSize)) {
+            data += prefixSize;
+            size -= prefixSize;
+            break;
+        }
+    }
+
+    if (size == ServiceIDSize + suffixSize && equalsLowered(data + ServiceIDSize, suffix, suffixSize))
+        size -= suffixSize;
+    if (size != ServiceIDSize)
+        return re;
+
+    quint32 buffer = 0;
+    int bits = 0, out = 0;
+    for (int i = 0; i < ServiceIDSize; i++) {
+        quint8 v = base32Value(data[i]);
+        if (v > 31)
+            return re;
+        buffer = (buffer << 5) | v;
+        bits += 5;
+        if (bits >= 8) {
+            bits -= 8;
+            re.m_digest[out++] = quint8(buffer >> bits);
+        }
+    }
+
+    re.m_valid = true;
+    return re;
+}
+
+OnionAddress OnionAddress::fromString(const QString &text)
+{
+    return parse(reinterpret_cast<const ushort*>(text.constData()), text.size());
+}
+
+OnionAddress OnionAddress::fromString(const QByteArray &text)
+{
+    return parse(reinterpret_cast<const uchar*>(text.constData()), text.size());
+}
+
+OnionAddress OnionAddress::fromDigest(const QByteArray &digest)
+{
+    OnionAddress re;
+    if (digest.size() < DigestSize)
+        return re;
+
+    memcpy(re.m_digest, digest.constData(), DigestSize);
+    re.m_valid = true;
+    return re;
+}
+
+QByteArray OnionAddress::digest() const
+{
+    if (!m_valid)
+        return QByteArray();
+    return QByteArray(reinterpret_cast<const char*>(m_digest), DigestSize);
+}
+
+QString OnionAddress::serviceID() const
+{
+    if (!m_valid)
+        return QString();
+
+    char buf[ServiceIDSize + 1];
+    base32_encode(buf, sizeof(buf), reinterpret_cast<const char*>(m_digest), DigestSize);
+    return QString::fromLatin1(buf, ServiceIDSize);
+}
+
+QString OnionAddress::hostname() const
+{
+    if (!m_valid)
+        return QString();
+    return serviceID() + QLatin1String(".onion");
+}
+
+QString OnionAddress::contactID() const
+{
+    if (!m_valid)
+        return QString();
+    return QLatin1String("ricochet:") + serviceID();
+}
+
+void base32_encode(char *dest, unsigned destlen, const char *src, unsigned srclen)
+{
+    unsigned nbits = srclen * 8;
+
+    /* We need an even multiple of 5 bits, and enough space */
+    if ((nbits % 5) != 0 || destlen < (nbits / 5) + 1) {
+        Q_ASSERT(false);
+        memset(dest, 0, destlen);
+        return;
+    }
+
+    quint32 buffer = 0;
+    int bits = 0;
+    for (unsigned i = 0; i < srclen; i++) {
+        buffer = (buffer << 8) | quint8(src[i]);
+        bits += 8;
+        while (bits >= 5) {
+            bits -= 5;
+            *dest++ = base32Alphabet[(buffer >> bits) & 0x1f];
+        }
+    }
+
+    *dest = '\0';
+}
+
+bool base32_decode(char *dest, unsigned destlen, const char *src, unsigned srclen)
+{
+    unsigned nbits = srclen * 5;
+
+    /* We need an even multiple of 8 bits, and enough space */
+    if ((nbits % 8) != 0 || (nbits / 8) + 1 > destlen) {
+        Q_ASSERT(false);
+        return false;
+    }
+
+    quint32 buffer = 0;
+    int bits = 0;
+    for (unsigned i = 0; i < srclen; i++) {
+        quint8 v = base32Values[quint8(src[i])];
+        if (v > 31)
+            return false;
+        buffer = (buffer << 5) | v;
+        bits += 5;
+        if (bits >= 8) {
+            bits -= 8;
+            *dest++ = char(buffer >> bits);
+        }
+    }
+
+    return true;
+}
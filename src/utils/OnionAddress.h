@@ -0,0 +1,121 @@
+/* Ricochet - https://ricochet.im/
+ * Copyright (C) 2014, John Brooks <john.brooks@dereferenced.net>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *    * Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following disclaimer
+ *      in the documentation and/or other materials provided with the
+ *      distribution.
+ *
+ *    * Neither the names of the copyright owners nor the names of its
+ *      contributors may be used to endorse or promote products derived from
+ *      this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef ONIONADDRESS_H
+#define ONIONADDRESS_H
+
+#include <QString>
+#include <QByteArray>
+#include <QMetaType>
+#include <cstring>
+
+/* Identity of an onion service, as the 80-bit digest its hostname encodes
+ *
+ * Onion identities appear as service IDs ("abcdefghijklmnop"), hostnames
+ * ("abcdefghijklmnop.onion") and contact IDs ("ricochet:abcdefghijklmnop").
+ * OnionAddress parses any of those forms, case-insensitively and without
+ * allocating, into a small value type that can be compared and hashed
+ * directly. Use it as the key when looking up contacts, requests and
+ * authenticated peers, and convert back to strings only for display or
+ * storage.
+ */
+class OnionAddress
+{
+public:
+    static const int DigestSize = 10;
+    static const int ServiceIDSize = 16;
+
+    OnionAddress()
+        : m_valid(false)
+    {
+        memset(m_digest, 0, sizeof(m_digest));
+    }
+
+    /* Parse a service ID, hostname or contact ID. Returns an invalid address
+     * if the text is not one of those forms. */
+    static OnionAddress fromString(const QString &text);
+    static OnionAddress fromString(const QByteArray &text);
+    /* Use the first DigestSize bytes of a public key digest */
+    static OnionAddress fromDigest(const QByteArray &digest);
+
+    bool isValid() const { return m_valid; }
+
+    QByteArray digest() const;
+    /* Lowercase service ID, without ".onion" */
+    QString serviceID() const;
+    /* Service ID with the ".onion" suffix */
+    QString hostname() const;
+    /* Service ID with the "ricochet:" prefix */
+    QString contactID() const;
+
+    bool operator==(const OnionAddress &other) const
+    {
+        return m_valid == other.m_valid && memcmp(m_digest, other.m_digest, DigestSize) == 0;
+    }
+    bool operator!=(const OnionAddress &other) const { return !(*this == other); }
+    bool operator<(const OnionAddress &other) const
+    {
+        if (m_valid != other.m_valid)
+            return !m_valid;
+        return memcmp(m_digest, other.m_digest, DigestSize) < 0;
+    }
+
+private:
+    friend uint qHash(const OnionAddress &address, uint seed);
+
+    quint8 m_digest[DigestSize];
+    bool m_valid;
+
+    template<typename T> static OnionAddress parse(const T *data, int size);
+};
+
+/* The digest is already uniformly distributed, so its leading bytes are the hash */
+inline uint qHash(const OnionAddress &address, uint seed = 0)
+{
+    uint re;
+    memcpy(&re, address.m_digest, sizeof(re));
+    return re ^ seed;
+}
+
+Q_DECLARE_TYPEINFO(OnionAddress, Q_MOVABLE_TYPE);
+Q_DECLARE_METATYPE(OnionAddress)
+
+/* Base32 encoding as in RFC 4648, using the lowercase alphabet and no padding
+ *
+ * base32_encode requires srclen*8 to be a multiple of 5 and writes a
+ * terminating null byte. base32_decode requires srclen*5 to be a multiple
+ * of 8, accepts either case, and returns false for any invalid character.
+ */
+void base32_encode(char *dest, unsigned destlen, const char *src, unsigned srclen);
+bool base32_decode(char *dest, unsigned destlen, const char *src, unsigned srclen);
+
+#endif // ONIONADDRESS_H
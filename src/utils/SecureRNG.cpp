@@ -32,9 +32,12 @@
 
 #include "SecureRNG.h"
 #include <QtDebug>
+#include <QThreadStorage>
 #include <openssl/rand.h>
 #include <openssl/err.h>
+#include <openssl/crypto.h>
 #include <limits.h>
+#include <string.h>
 
 #ifdef Q_OS_WIN
 #include <Wincrypt.h>
@@ -93,13 +96,74 @@ bool SecureRNG::seed()
     return true;
 }
 
-void SecureRNG::random(char *buf, int size)
+static void opensslRandom(unsigned char *buf, int size)
 {
-    int r = RAND_bytes(reinterpret_cast<unsigned char*>(buf), size);
+    int r = RAND_bytes(buf, size);
     if (r <= 0)
         qFatal("RNG failed: %lu", ERR_get_error());
 }
 
+namespace {
+
+struct RandomPool
+{
+    static const int Size = 4096;
+    // Requests at least this large bypass the pool
+    static const int DirectThreshold = 256;
+
+    unsigned char data[Size];
+    int position;
+
+    RandomPool()
+        : position(Size)
+    {
+    }
+
+    ~RandomPool()
+    {
+        OPENSSL_cleanse(data, sizeof(data));
+    }
+
+    void take(unsigned char *buf, int size)
+    {
+        while (size > 0) {
+            if (position == Size) {
+                opensslRandom(data, Size);
+                position = 0;
+            }
+
+            int count = qMin(size, Size - position);
+            memcpy(buf, data + position, count);
+            OPENSSL_cleanse(data + position, count);
+            position += count;
+            buf += count;
+            size -= count;
+        }
+    }
+};
+
+}
+
+static QThreadStorage<RandomPool*> randomPools;
+
+static RandomPool *randomPool()
+{
+    if (!randomPools.hasLocalData())
+        randomPools.setLocalData(new RandomPool);
+    return randomPools.localData();
+}
+
+void SecureRNG::random(char *buf, int size)
+{
+    if (size <= 0)
+        return;
+
+    if (size >= RandomPool::DirectThreshold)
+        opensslRandom(reinterpret_cast<unsigned char*>(buf), size);
+    else
+        randomPool()->take(reinterpret_cast<unsigned char*>(buf), size);
+}
+
 QByteArray SecureRNG::random(int size)
 {
     QByteArray re(size, 0);
@@ -109,23 +173,45 @@ QByteArray SecureRNG::random(int size)
 
 QByteArray SecureRNG::randomPrintable(int length)
 {
+    /* Each random byte below 190 maps evenly onto the 95 printable
+     * characters; others are discarded. Bytes are drawn in batches. */
     QByteArray re(length, 0);
-    for (int i = 0; i < re.size(); i++)
-        re[i] = randomInt(95) + 32;
+    unsigned char buf[64];
+    int i = 0;
+    while (i < length) {
+        int count = qMin<int>(sizeof(buf), length - i);
+        random(reinterpret_cast<char*>(buf), count);
+        for (int j = 0; j < count; j++) {
+            if (buf[j] < 190)
+                re[i++] = char(buf[j] % 95 + 32);
+        }
+    }
+    OPENSSL_cleanse(buf, sizeof(buf));
     return re;
 }
 
 unsigned SecureRNG::randomInt(unsigned max)
 {
-    unsigned cutoff = UINT_MAX - (UINT_MAX % max);
-    unsigned value = 0;
-
-    for (;;)
-    {
-        random(reinterpret_cast<char*>(&value), sizeof(value));
-        if (value < cutoff)
-            return value % max;
+    if (max <= 1)
+        return 0;
+
+    /* Multiply-and-shift, rejecting only the few products which would bias
+     * the result; usually a single 32-bit draw with no division. */
+    quint32 value = 0;
+    random(reinterpret_cast<char*>(&value), sizeof(value));
+    quint64 product = quint64(value) * max;
+    quint32 low = quint32(product);
+
+    if (low < max) {
+        quint32 threshold = quint32(-max) % max;
+        while (low < threshold) {
+            random(reinterpret_cast<char*>(&value), sizeof(value));
+            product = quint64(value) * max;
+            low = quint32(product);
+        }
     }
+
+    return unsigned(product >> 32);
 }
 
 #ifndef UINT64_MAX
@@ -134,12 +220,15 @@ unsigned SecureRNG::randomInt(unsigned max)
 
 quint64 SecureRNG::randomInt64(quint64 max)
 {
+    if (max <= 1)
+        return 0;
+
     quint64 cutoff = UINT64_MAX - (UINT64_MAX % max);
     quint64 value = 0;
 
     for (;;)
     {
-        random(reinterpret_cast<char*>(value), sizeof(value));
+        random(reinterpret_cast<char*>(&value), sizeof(value));
         if (value < cutoff)
             return value % max;
     }
@@ -35,6 +35,18 @@
 
 #include <QByteArray>
 
+/* Cryptographically secure random data, from OpenSSL's generator
+ *
+ * Small requests are served from a per-thread buffer which is refilled from
+ * RAND_bytes in blocks, so that cookies, IDs and integers don't each take
+ * OpenSSL's locks. Bytes are erased from the buffer as they're handed out.
+ * Requests larger than a fraction of the buffer go to RAND_bytes directly.
+ * Refills can happen on any thread at once, so with OpenSSL before 1.1,
+ * CryptoExecutor::initializeThreading must be called before seed().
+ *
+ * randomInt and randomInt64 return a uniformly distributed value in the
+ * range [0, max).
+ */
 class SecureRNG
 {
 public:
@@ -39,8 +39,54 @@
 #include <QDir>
 #include <QFileInfo>
 #include <QTimer>
+#include <QThread>
 #include <QDebug>
 #include <QPointer>
+#include <QQmlPropertyMap>
+#include <climits>
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 12, 0)
+#include <QCborValue>
+#include <QCborMap>
+#endif
+
+class SettingsObjectPrivate;
+
+typedef QList<QPair<QStringList, QJsonValue> > ModifiedList;
+
+/* Index of SettingsObject instances by path, used to deliver change
+ * notifications only to objects with a path on or under the changed key. */
+struct SettingsSubscriptionNode
+{
+    QList<SettingsObjectPrivate*> objects;
+    QHash<QString,SettingsSubscriptionNode*> children;
+
+    ~SettingsSubscriptionNode() { qDeleteAll(children); }
+};
+
+/* SettingsWriter serializes and writes settings data on a dedicated thread,
+ * so slow disks don't block the GUI thread. Requests are handled in the order
+ * they're made. Data is passed as QJsonObject snapshots, which are implicitly
+ * shared and never modified by the writer. */
+class SettingsWriter : public QObject
+{
+    Q_OBJECT
+
+public:
+    static bool writeDocument(const QString &path, const QJsonObject &root, int format,
+                              QString &errorMessage, qint64 &size);
+
+public slots:
+    void appendJournal(const QString &path, const QByteArray &data);
+    void writeFile(const QString &path, const QJsonObject &root, int format, const QStringList &removePaths);
+    // Used with a blocking call to wait for all previous requests
+    void flush() { }
+
+signals:
+    void fileWritten(const QString &path, int format, qint64 size);
+    void journalFailed();
+    void error(const QString &message);
+};
 
 class SettingsFilePrivate : public QObject
 {
@@ -51,8 +97,21 @@ public:
     QString filePath;
     QString errorMessage;
     QTimer syncTimer;
+    QTimer compactTimer;
     QJsonObject jsonRoot;
     SettingsObject *rootObject;
+    QByteArray journalBuffer;
+    qint64 journalSize;
+    qint64 fileSize;
+    SettingsSubscriptionNode subscriptions;
+    SettingsFile::Format format;
+    QList<QFile*> mappedFiles;
+    bool jsonStale;
+    int transactionDepth;
+    QJsonObject transactionBase;
+    QList<QStringList> transactionPaths;
+    QThread writerThread;
+    SettingsWriter *writer;
 
     SettingsFilePrivate(SettingsFile *qp);
     virtual ~SettingsFilePrivate();
@@ -61,17 +120,37 @@ public:
     void setError(const QString &message);
     bool checkDirPermissions(const QString &path);
     bool readFile();
-    bool writeFile();
+    bool readSnapshot();
+    void writeFile(SettingsFile::Format format, const QString &path, const QStringList &removePaths = QStringList());
+    void flushWriter();
+
+    QString snapshotPath() const;
+
+    QString journalPath() const;
+    int readJournal();
+    void queueJournal(const QStringList &path, const QJsonValue &value);
 
     static QStringList splitPath(const QString &input, bool &ok);
     QJsonValue read(const QJsonObject &base, const QStringList &path);
     bool write(const QStringList &path, const QJsonValue &value);
+    void commitTransaction();
 
-signals:
+    void subscribe(SettingsObjectPrivate *object, const QStringList &path);
+    void unsubscribe(SettingsObjectPrivate *object, const QStringList &path);
     void modified(const QStringList &path, const QJsonValue &value);
+    void modified(const ModifiedList &list);
+    void collectAffected(QList<QPointer<SettingsObjectPrivate> > &list, const QStringList &key);
+    void refreshAffected(const QStringList &key);
+    void detachSubscribers();
+
+signals:
+    void writeJournalRequested(const QString &path, const QByteArray &data);
+    void writeFileRequested(const QString &path, const QJsonObject &root, int format, const QStringList &removePaths);
 
 private slots:
     void sync();
+    bool compact();
+    void fileWritten(const QString &path, int format, qint64 size);
 };
 
 SettingsFile::SettingsFile(QObject *parent)
@@ -84,30 +163,82 @@ SettingsFile::~SettingsFile()
 {
 }
 
+/* The journal is compacted into the main file once it is larger than both
+ * this size and the main file itself. Compaction waits for compactDelay, so
+ * a burst of writes doesn't also cause a burst of full rewrites. */
+static const qint64 minimumCompactSize = 32 * 1024;
+static const int compactDelay = 5000;
+
 SettingsFilePrivate::SettingsFilePrivate(SettingsFile *qp)
     : QObject(qp)
     , q(qp)
     , rootObject(0)
+    , journalSize(0)
+    , fileSize(0)
+    , format(SettingsFile::JsonFormat)
+    , jsonStale(false)
+    , transactionDepth(0)
+    , writer(new SettingsWriter)
 {
-    syncTimer.setInterval(0);
+    syncTimer.setInterval(500);
     syncTimer.setSingleShot(true);
     connect(&syncTimer, &QTimer::timeout, this, &SettingsFilePrivate::sync);
+
+    compactTimer.setInterval(compactDelay);
+    compactTimer.setSingleShot(true);
+    connect(&compactTimer, &QTimer::timeout, this, &SettingsFilePrivate::compact);
+
+    writer->moveToThread(&writerThread);
+    connect(this, &SettingsFilePrivate::writeJournalRequested, writer, &SettingsWriter::appendJournal);
+    connect(this, &SettingsFilePrivate::writeFileRequested, writer, &SettingsWriter::writeFile);
+    connect(writer, &SettingsWriter::fileWritten, this, &SettingsFilePrivate::fileWritten);
+    connect(writer, &SettingsWriter::journalFailed, this, &SettingsFilePrivate::compact);
+    connect(writer, &SettingsWriter::error, this, &SettingsFilePrivate::setError);
+    writerThread.setObjectName(QStringLiteral("SettingsWriter"));
+    writerThread.start(QThread::LowPriority);
 }
 
 SettingsFilePrivate::~SettingsFilePrivate()
 {
-    if (syncTimer.isActive())
-        sync();
+    // Leave a single, complete file behind on a clean shutdown. With a binary
+    // snapshot, the readable file is also brought up to date; the snapshot is
+    // written last so it is preferred when loading.
+    bool dirty = syncTimer.isActive() || journalSize > 0;
+    if (format == SettingsFile::BinaryFormat && !filePath.isEmpty() && (dirty || jsonStale))
+        writeFile(SettingsFile::JsonFormat, filePath);
+    if (dirty || jsonStale)
+        compact();
+
+    // Wait for everything to reach the disk before exiting
+    flushWriter();
+    writerThread.quit();
+    writerThread.wait();
+    delete writer;
+
     delete rootObject;
+    detachSubscribers();
+
+    // Loaded data may reference mapped snapshots until this point
+    jsonRoot = QJsonObject();
+    qDeleteAll(mappedFiles);
 }
 
 void SettingsFilePrivate::reset()
 {
+    // Writes for the previous file must finish before another file is read
+    flushWriter();
+
     filePath.clear();
     errorMessage.clear();
+    syncTimer.stop();
+    compactTimer.stop();
+    journalBuffer.clear();
+    journalSize = 0;
+    fileSize = 0;
+    jsonStale = false;
 
     jsonRoot = QJsonObject();
-    emit modified(QStringList(), jsonRoot);
+    modified(QStringList(), jsonRoot);
 }
 
 QString SettingsFile::filePath() const
@@ -147,6 +278,84 @@ bool SettingsFile::hasError() const
     return !d->errorMessage.isEmpty();
 }
 
+SettingsFile::Format SettingsFile::format() const
+{
+    return d->format;
+}
+
+void SettingsFile::setFormat(Format format)
+{
+    if (d->format == format)
+        return;
+
+    d->format = format;
+    emit formatChanged();
+
+    // Convert the existing data now rather than on the next compaction
+    if (!d->filePath.isEmpty())
+        d->compact();
+}
+
+bool SettingsFile::exportJson(const QString &path)
+{
+    QString errorMessage;
+    qint64 size = 0;
+    if (!SettingsWriter::writeDocument(path, d->jsonRoot, JsonFormat, errorMessage, size)) {
+        qWarning() << "Exporting settings to" << path << "failed:" << errorMessage;
+        return false;
+    }
+
+    return true;
+}
+
+void SettingsFile::beginTransaction()
+{
+    if (d->transactionDepth++ == 0)
+        d->transactionBase = d->jsonRoot;
+}
+
+void SettingsFile::commitTransaction()
+{
+    d->commitTransaction();
+}
+
+SettingsTransaction::SettingsTransaction(SettingsFile *file)
+    : file(file)
+{
+    if (file)
+        file->beginTransaction();
+}
+
+SettingsTransaction::SettingsTransaction(SettingsObject *object)
+    : file(object->file())
+{
+    if (file)
+        file->beginTransaction();
+}
+
+SettingsTransaction::~SettingsTransaction()
+{
+    commit();
+}
+
+void SettingsTransaction::commit()
+{
+    if (file) {
+        file->commitTransaction();
+        file = 0;
+    }
+}
+
+int SettingsFile::syncInterval() const
+{
+    return d->syncTimer.interval();
+}
+
+void SettingsFile::setSyncInterval(int msec)
+{
+    d->syncTimer.setInterval(qMax(0, msec));
+}
+
 void SettingsFilePrivate::setError(const QString &message)
 {
     errorMessage = message;
@@ -186,69 +395,354 @@ void SettingsFilePrivate::sync()
         return;
 
     syncTimer.stop();
-    writeFile();
+
+    // If the journal can't be written, the writer falls back to compaction
+    if (!journalBuffer.isEmpty()) {
+        journalSize += journalBuffer.size();
+        emit writeJournalRequested(journalPath(), journalBuffer);
+        journalBuffer.clear();
+    }
+
+    if (journalSize > qMax(minimumCompactSize, fileSize) && !compactTimer.isActive())
+        compactTimer.start();
+}
+
+bool SettingsFilePrivate::compact()
+{
+    if (filePath.isEmpty())
+        return false;
+
+    syncTimer.stop();
+    compactTimer.stop();
+
+    // Anything still buffered for the journal is included in the full write,
+    // and the journal is removed once that write succeeds.
+    journalBuffer.clear();
+    journalSize = 0;
+
+    QStringList removePaths;
+    removePaths.append(journalPath());
+
+    if (format == SettingsFile::BinaryFormat) {
+        writeFile(format, snapshotPath(), removePaths);
+        jsonStale = true;
+    } else {
+        // A leftover snapshot would be preferred over the file when loading
+        removePaths.append(snapshotPath());
+        writeFile(format, filePath, removePaths);
+        jsonStale = false;
+    }
+
+    return true;
+}
+
+void SettingsFilePrivate::writeFile(SettingsFile::Format fileFormat, const QString &path, const QStringList &removePaths)
+{
+    emit writeFileRequested(path, jsonRoot, fileFormat, removePaths);
+}
+
+void SettingsFilePrivate::flushWriter()
+{
+    if (!QMetaObject::invokeMethod(writer, "flush", Qt::BlockingQueuedConnection))
+        qWarning() << "Failed waiting for settings to be written";
+}
+
+void SettingsFilePrivate::fileWritten(const QString &path, int fileFormat, qint64 size)
+{
+    Q_UNUSED(path);
+    if (fileFormat == format)
+        fileSize = size;
 }
 
 bool SettingsFilePrivate::readFile()
 {
+    // A snapshot is used unless the readable file was modified after it, in
+    // which case the readable file was edited or imported and takes priority.
+    QFileInfo fileInfo(filePath);
+    QFileInfo snapshotInfo(snapshotPath());
+    bool useSnapshot = snapshotInfo.exists() &&
+                       (!fileInfo.exists() || snapshotInfo.lastModified() >= fileInfo.lastModified());
+
     QFile file(filePath);
     if (!file.open(QIODevice::ReadWrite)) {
         setError(file.errorString());
         return false;
     }
 
-    QByteArray data = file.readAll();
-    if (data.isEmpty() && (file.error() != QFileDevice::NoError || file.size() > 0)) {
-        setError(file.errorString());
-        return false;
+    jsonRoot = QJsonObject();
+    bool needsCompact = false;
+
+    if (useSnapshot && readSnapshot()) {
+        jsonStale = true;
+    } else {
+        QByteArray data = file.readAll();
+        if (data.isEmpty() && (file.error() != QFileDevice::NoError || file.size() > 0)) {
+            setError(file.errorString());
+            return false;
+        }
+
+        fileSize = data.size();
+
+        if (!data.isEmpty()) {
+            QJsonParseError parseError;
+            QJsonDocument document = QJsonDocument::fromJson(data, &parseError);
+            if (document.isNull()) {
+                setError(parseError.errorString());
+                return false;
+            }
+
+            if (!document.isObject()) {
+                setError(QStringLiteral("Invalid configuration file (expected object)"));
+                return false;
+            }
+
+            jsonRoot = document.object();
+        }
+
+        // Create the snapshot now, so it can be used for the next load
+        needsCompact = format == SettingsFile::BinaryFormat && !jsonRoot.isEmpty();
     }
 
-    if (data.isEmpty()) {
-        jsonRoot = QJsonObject();
-        return true;
+    // Changes from a previous run that were never compacted are applied and
+    // folded back into the main file immediately.
+    if (readJournal() > 0 || needsCompact)
+        compact();
+
+    if (!jsonRoot.isEmpty())
+        modified(QStringList(), jsonRoot);
+    return true;
+}
+
+/* Before Qt 5.12, snapshots use Qt's binary JSON representation, which is
+ * the in-memory format of QJsonDocument. A mapped snapshot is used in place
+ * without parsing; values are only decoded as they are read. Binary JSON is
+ * deprecated from Qt 5.15 and removed in Qt 6, so later versions write CBOR,
+ * which is parsed when loading but still much faster than JSON text. A
+ * snapshot in the other format is ignored, and the JSON file is used. */
+bool SettingsFilePrivate::readSnapshot()
+{
+    QScopedPointer<QFile> file(new QFile(snapshotPath()));
+    if (!file->open(QIODevice::ReadOnly) || file->size() <= 0 || file->size() > INT_MAX) {
+        qWarning() << "Cannot read settings snapshot:" << file->errorString();
+        return false;
     }
 
-    QJsonParseError parseError;
-    QJsonDocument document = QJsonDocument::fromJson(data);
-    if (document.isNull()) {
-        setError(parseError.errorString());
+    int size = int(file->size());
+#if QT_VERSION >= QT_VERSION_CHECK(5, 12, 0)
+    QCborParserError parseError;
+    QCborValue value = QCborValue::fromCbor(file->readAll(), &parseError);
+    if (parseError.error != QCborError::NoError || !value.isMap()) {
+        qWarning() << "Ignoring invalid settings snapshot" << snapshotPath();
         return false;
     }
 
+    jsonRoot = value.toMap().toJsonObject();
+    fileSize = size;
+    return true;
+#else
+    const char *data = reinterpret_cast<const char*>(file->map(0, size));
+    QJsonDocument document;
+    if (!data) {
+        document = QJsonDocument::fromBinaryData(file->readAll());
+    } else {
+#ifdef Q_OS_WIN
+        // Windows can't replace a file that is mapped, so copy the data out
+        document = QJsonDocument::fromBinaryData(QByteArray::fromRawData(data, size));
+        file->unmap(reinterpret_cast<uchar*>(const_cast<char*>(data)));
+        data = 0;
+#else
+        document = QJsonDocument::fromRawData(data, size);
+#endif
+    }
+
     if (!document.isObject()) {
-        setError(QStringLiteral("Invalid configuration file (expected object)"));
+        qWarning() << "Ignoring invalid settings snapshot" << snapshotPath();
         return false;
     }
 
     jsonRoot = document.object();
+    fileSize = size;
 
-    emit modified(QStringList(), jsonRoot);
+    // The mapping must remain valid for as long as any value refers to it
+    if (data)
+        mappedFiles.append(file.take());
     return true;
+#endif
 }
 
-bool SettingsFilePrivate::writeFile()
+bool SettingsWriter::writeDocument(const QString &path, const QJsonObject &root, int format,
+                                   QString &errorMessage, qint64 &size)
 {
-    QSaveFile file(filePath);
+    QSaveFile file(path);
     if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
-        setError(file.errorString());
+        errorMessage = file.errorString();
         return false;
     }
 
-    QJsonDocument document(jsonRoot);
-    QByteArray data = document.toJson();
+    QJsonDocument document(root);
+    QByteArray data;
+    if (format == SettingsFile::BinaryFormat)
+#if QT_VERSION >= QT_VERSION_CHECK(5, 12, 0)
+        data = QCborMap::fromJsonObject(root).toCborValue().toCbor();
+#else
+        data = document.toBinaryData();
+#endif
+    else
+        data = document.toJson();
     if (data.isEmpty() && !document.isEmpty()) {
-        setError(QStringLiteral("Encoding failure"));
+        errorMessage = QStringLiteral("Encoding failure");
         return false;
     }
 
     if (file.write(data) < data.size() || !file.commit()) {
-        setError(file.errorString());
+        errorMessage = file.errorString();
         return false;
     }
 
+    size = data.size();
     return true;
 }
 
+void SettingsWriter::writeFile(const QString &path, const QJsonObject &root, int format, const QStringList &removePaths)
+{
+    QString errorMessage;
+    qint64 size = 0;
+    if (!writeDocument(path, root, format, errorMessage, size)) {
+        emit error(errorMessage);
+        return;
+    }
+
+    foreach (const QString &removePath, removePaths) {
+        if (QFile::exists(removePath) && !QFile::remove(removePath))
+            qWarning() << "Failed to remove" << removePath << "after writing settings";
+    }
+
+    emit fileWritten(path, format, size);
+}
+
+void SettingsWriter::appendJournal(const QString &path, const QByteArray &data)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        qWarning() << "Cannot open settings journal:" << file.errorString();
+        emit journalFailed();
+        return;
+    }
+
+    if (file.write(data) < data.size() || !file.flush()) {
+        qWarning() << "Cannot write settings journal:" << file.errorString();
+        emit journalFailed();
+        return;
+    }
+}
+
+QString SettingsFilePrivate::snapshotPath() const
+{
+    return filePath + QStringLiteral(".snapshot");
+}
+
+QString SettingsFilePrivate::journalPath() const
+{
+    return filePath + QStringLiteral(".journal");
+}
+
+/* Replace the value at path under root, building intermediate objects as
+ * necessary. Returns false without changes if the value is already equal,
+ * otherwise originalValue is set to the previous value. */
+static bool replaceValue(QJsonObject &root, const QStringList &path, const QJsonValue &value, QJsonValue &originalValue)
+{
+    typedef QVarLengthArray<QPair<QString,QJsonObject> > ObjectStack;
+    ObjectStack stack;
+    QJsonValue current = root;
+    QString currentKey;
+
+    foreach (const QString &key, path) {
+        const QJsonObject &parent = current.toObject();
+        stack.append(qMakePair(currentKey, parent));
+        current = parent.value(key);
+        currentKey = key;
+    }
+
+    // Stack now contains parent objects starting with the root, and current
+    // is the old value. Write back changes in reverse.
+    if (current == value)
+        return false;
+    originalValue = current;
+    current = value;
+
+    ObjectStack::const_iterator it = stack.end(), begin = stack.begin();
+    while (it != begin) {
+        --it;
+        QJsonObject update = it->second;
+        update.insert(currentKey, current);
+        current = update;
+        currentKey = it->first;
+    }
+
+    // current is now the updated root
+    root = current.toObject();
+    return true;
+}
+
+/* The journal is a sequence of lines, each a compact JSON object with the
+ * key "path" (array of keys) and "value". A missing value removes the key.
+ * Records are absolute, so replaying a journal that was already compacted
+ * is harmless. Returns the number of records applied. */
+int SettingsFilePrivate::readJournal()
+{
+    QFile file(journalPath());
+    if (!file.exists())
+        return 0;
+
+    if (!file.open(QIODevice::ReadOnly)) {
+        qWarning() << "Cannot read settings journal:" << file.errorString();
+        return 0;
+    }
+
+    int count = 0;
+    while (!file.atEnd()) {
+        QByteArray line = file.readLine().trimmed();
+        if (line.isEmpty())
+            continue;
+
+        QJsonObject record = QJsonDocument::fromJson(line).object();
+        QJsonValue path = record.value(QStringLiteral("path"));
+        if (!path.isArray()) {
+            // Most likely a record cut short by a crash; nothing after it is trustworthy
+            qWarning() << "Ignoring corrupt settings journal record";
+            break;
+        }
+
+        QStringList keys;
+        foreach (const QJsonValue &key, path.toArray())
+            keys.append(key.toString());
+
+        QJsonValue originalValue;
+        replaceValue(jsonRoot, keys, record.value(QStringLiteral("value")), originalValue);
+        count++;
+    }
+
+    journalSize = file.size();
+    return count;
+}
+
+void SettingsFilePrivate::queueJournal(const QStringList &path, const QJsonValue &value)
+{
+    if (filePath.isEmpty())
+        return;
+
+    QJsonObject record;
+    record.insert(QStringLiteral("path"), QJsonArray::fromStringList(path));
+    record.insert(QStringLiteral("value"), value);
+
+    journalBuffer.append(QJsonDocument(record).toJson(QJsonDocument::Compact));
+    journalBuffer.append('\n');
+
+    // Not restarted by later writes, so the delay to disk stays bounded
+    if (!syncTimer.isActive())
+        syncTimer.start();
+}
+
 QStringList SettingsFilePrivate::splitPath(const QString &input, bool &ok)
 {
     QStringList components = input.split(QLatin1Char('.'));
@@ -284,7 +778,6 @@ QJsonValue SettingsFilePrivate::read(const QJsonObject &base, const QStringList
 
 // Compare two QJsonValue to find keys that have changed,
 // recursing into objects and building paths as necessary.
-typedef QList<QPair<QStringList, QJsonValue> > ModifiedList;
 static void findModifiedRecursive(ModifiedList &modified, const QStringList &path, const QJsonValue &oldValue, const QJsonValue &newValue)
 {
     if (oldValue.isObject() || newValue.isObject()) {
@@ -320,67 +813,270 @@ static void findModifiedRecursive(ModifiedList &modified, const QStringList &pat
 
 bool SettingsFilePrivate::write(const QStringList &path, const QJsonValue &value)
 {
-    typedef QVarLengthArray<QPair<QString,QJsonObject> > ObjectStack;
-    ObjectStack stack;
-    QJsonValue current = jsonRoot;
     QJsonValue originalValue;
-    QString currentKey;
-
-    foreach (const QString &key, path) {
-        const QJsonObject &parent = current.toObject();
-        stack.append(qMakePair(currentKey, parent));
-        current = parent.value(key);
-        currentKey = key;
-    }
-
-    // Stack now contains parent objects starting with the root, and current
-    // is the old value. Write back changes in reverse.
-    if (current == value)
+    if (!replaceValue(jsonRoot, path, value, originalValue))
         return false;
-    originalValue = current;
-    current = value;
 
-    ObjectStack::const_iterator it = stack.end(), begin = stack.begin();
-    while (it != begin) {
-        --it;
-        QJsonObject update = it->second;
-        update.insert(currentKey, current);
-        current = update;
-        currentKey = it->first;
+    // Within a transaction, changes are journaled and notified on commit
+    if (transactionDepth > 0) {
+        transactionPaths.append(path);
+        refreshAffected(path);
+        return true;
     }
 
-    // current is now the updated jsonRoot
-    jsonRoot = current.toObject();
-    syncTimer.start();
+    queueJournal(path, value);
 
     ModifiedList modified;
     findModifiedRecursive(modified, path, originalValue, value);
+    this->modified(modified);
 
-    for (ModifiedList::iterator it = modified.begin(); it != modified.end(); it++)
-        emit this->modified(it->first, it->second);
+    return true;
+}
+
+static bool isPathPrefix(const QStringList &prefix, const QStringList &path)
+{
+    if (prefix.size() > path.size())
+        return false;
+
+    for (int i = 0; i < prefix.size(); i++) {
+        if (prefix[i] != path[i])
+            return false;
+    }
 
     return true;
 }
 
+void SettingsFilePrivate::commitTransaction()
+{
+    if (transactionDepth <= 0) {
+        qWarning() << "Settings transaction committed without beginning a transaction";
+        return;
+    }
+
+    if (--transactionDepth > 0)
+        return;
+
+    // Reduce to the outermost paths that were written; anything changed below
+    // those is found by comparing with the value before the transaction.
+    QList<QStringList> paths;
+    foreach (const QStringList &path, transactionPaths) {
+        bool covered = false;
+        for (int i = 0; i < paths.size(); ) {
+            if (isPathPrefix(paths[i], path)) {
+                covered = true;
+                break;
+            } else if (isPathPrefix(path, paths[i])) {
+                paths.removeAt(i);
+            } else {
+                i++;
+            }
+        }
+
+        if (!covered)
+            paths.append(path);
+    }
+
+    QJsonObject base = transactionBase;
+    transactionBase = QJsonObject();
+    transactionPaths.clear();
+
+    ModifiedList modified;
+    foreach (const QStringList &path, paths) {
+        QJsonValue oldValue = read(base, path);
+        QJsonValue newValue = read(jsonRoot, path);
+        if (oldValue == newValue)
+            continue;
+
+        queueJournal(path, newValue);
+        findModifiedRecursive(modified, path, oldValue, newValue);
+    }
+
+    this->modified(modified);
+}
+
 class SettingsObjectPrivate : public QObject
 {
     Q_OBJECT
 
 public:
     explicit SettingsObjectPrivate(SettingsObject *q);
+    virtual ~SettingsObjectPrivate();
 
     SettingsObject *q;
     SettingsFile *file;
     QStringList path;
     QJsonObject object;
     bool invalid;
+    bool subscribed;
+    bool dataChangedPending;
+    QQmlPropertyMap *values;
+
+    // SettingsKey handles used with this object, by key string
+    struct KeyEntry
+    {
+        QStringList path;
+        QVariant value;
+        bool cached;
+    };
+    QHash<const char*,KeyEntry> keys;
 
     void setFile(SettingsFile *file);
+    void setSubscribed(bool subscribed);
+    void updateValues(const QString &key = QString());
+    KeyEntry &keyEntry(const char *key);
+    void invalidateKeys(const QStringList &key = QStringList());
 
-public slots:
+    void refresh(const QStringList &absolutePath);
     void modified(const QStringList &absolutePath, const QJsonValue &value);
 };
 
+/* Top-level keys of a SettingsObject as properties, for QML bindings that
+ * should only be notified when their own key changes. */
+class SettingsValueMap : public QQmlPropertyMap
+{
+    Q_OBJECT
+
+public:
+    explicit SettingsValueMap(SettingsObject *parent)
+        : QQmlPropertyMap(this, parent), settings(parent)
+    {
+    }
+
+protected:
+    virtual QVariant updateValue(const QString &key, const QVariant &input)
+    {
+        settings->write(key, QJsonValue::fromVariant(input));
+        return input;
+    }
+
+private:
+    SettingsObject *settings;
+};
+
+void SettingsFilePrivate::subscribe(SettingsObjectPrivate *object, const QStringList &path)
+{
+    SettingsSubscriptionNode *node = &subscriptions;
+    foreach (const QString &key, path) {
+        SettingsSubscriptionNode *&child = node->children[key];
+        if (!child)
+            child = new SettingsSubscriptionNode;
+        node = child;
+    }
+
+    node->objects.append(object);
+}
+
+void SettingsFilePrivate::unsubscribe(SettingsObjectPrivate *object, const QStringList &path)
+{
+    QVarLengthArray<SettingsSubscriptionNode*> parents;
+    SettingsSubscriptionNode *node = &subscriptions;
+    foreach (const QString &key, path) {
+        parents.append(node);
+        node = node->children.value(key);
+        if (!node)
+            return;
+    }
+
+    node->objects.removeOne(object);
+
+    // Prune nodes that no longer lead to any subscribers
+    for (int i = parents.size() - 1; i >= 0; i--) {
+        if (!node->objects.isEmpty() || !node->children.isEmpty())
+            break;
+        delete parents[i]->children.take(path[i]);
+        node = parents[i];
+    }
+}
+
+static void collectSubscribers(QList<QPointer<SettingsObjectPrivate> > &list, const SettingsSubscriptionNode *node)
+{
+    foreach (SettingsObjectPrivate *object, node->objects)
+        list.append(object);
+    foreach (const SettingsSubscriptionNode *child, node->children)
+        collectSubscribers(list, child);
+}
+
+// Objects with a path that contains key, or is under it
+void SettingsFilePrivate::collectAffected(QList<QPointer<SettingsObjectPrivate> > &list, const QStringList &key)
+{
+    const SettingsSubscriptionNode *node = &subscriptions;
+    foreach (const QString &component, key) {
+        foreach (SettingsObjectPrivate *object, node->objects)
+            list.append(object);
+        node = node->children.value(component);
+        if (!node)
+            return;
+    }
+
+    collectSubscribers(list, node);
+}
+
+/* Within a transaction, objects are notified on commit, but their cached data
+ * must still follow each write so reads see it. */
+void SettingsFilePrivate::refreshAffected(const QStringList &key)
+{
+    QList<QPointer<SettingsObjectPrivate> > targets;
+    collectAffected(targets, key);
+    foreach (const QPointer<SettingsObjectPrivate> &object, targets)
+        object->refresh(key);
+}
+
+void SettingsFilePrivate::modified(const QStringList &key, const QJsonValue &value)
+{
+    ModifiedList list;
+    list.append(qMakePair(key, value));
+    modified(list);
+}
+
+/* Notify objects with a path that contains each modified key, and objects
+ * under the key, which have been replaced along with it. dataChanged is
+ * emitted once for each object after all keys are delivered. */
+void SettingsFilePrivate::modified(const ModifiedList &list)
+{
+    // Handlers may create or destroy objects, so delivery happens on copies
+    QList<QPointer<SettingsObjectPrivate> > changed;
+
+    for (ModifiedList::const_iterator it = list.begin(); it != list.end(); it++) {
+        QList<QPointer<SettingsObjectPrivate> > targets;
+        collectAffected(targets, it->first);
+
+        foreach (const QPointer<SettingsObjectPrivate> &object, targets) {
+            if (!object)
+                continue;
+            if (!object->dataChangedPending) {
+                object->dataChangedPending = true;
+                changed.append(object);
+            }
+            object->modified(it->first, it->second);
+        }
+    }
+
+    foreach (const QPointer<SettingsObjectPrivate> &object, changed) {
+        if (object && object->dataChangedPending) {
+            object->dataChangedPending = false;
+            emit object->q->dataChanged();
+        }
+    }
+}
+
+// Objects that outlive the file become invalid rather than dangling
+void SettingsFilePrivate::detachSubscribers()
+{
+    QList<QPointer<SettingsObjectPrivate> > objects;
+    collectSubscribers(objects, &subscriptions);
+    foreach (const QPointer<SettingsObjectPrivate> &object, objects) {
+        object->subscribed = false;
+        object->file = 0;
+        object->invalid = true;
+        object->object = QJsonObject();
+        object->keys.clear();
+    }
+
+    qDeleteAll(subscriptions.children);
+    subscriptions.children.clear();
+    subscriptions.objects.clear();
+}
+
 SettingsObject::SettingsObject(QObject *parent)
     : QObject(parent)
     , d(new SettingsObjectPrivate(this))
@@ -419,7 +1115,15 @@ SettingsObjectPrivate::SettingsObjectPrivate(SettingsObject *qp)
     , q(qp)
     , file(0)
     , invalid(true)
+    , subscribed(false)
+    , dataChangedPending(false)
+    , values(0)
+{
+}
+
+SettingsObjectPrivate::~SettingsObjectPrivate()
 {
+    setSubscribed(false);
 }
 
 void SettingsObjectPrivate::setFile(SettingsFile *value)
@@ -427,30 +1131,94 @@ void SettingsObjectPrivate::setFile(SettingsFile *value)
     if (file == value)
         return;
 
-    if (file)
-        disconnect(file, 0, this, 0);
+    setSubscribed(false);
     file = value;
-    if (file)
-        connect(file->d, &SettingsFilePrivate::modified, this, &SettingsObjectPrivate::modified);
 }
 
-// Emit SettingsObject::modified with a relative path if path is matched
-void SettingsObjectPrivate::modified(const QStringList &key, const QJsonValue &value)
+void SettingsObjectPrivate::setSubscribed(bool value)
 {
-    if (key.size() < path.size())
+    if (!file || subscribed == value)
         return;
 
-    for (int i = 0; i < path.size(); i++) {
-        if (path[i] != key[i])
-            return;
+    subscribed = value;
+    if (subscribed)
+        file->d->subscribe(this, path);
+    else
+        file->d->unsubscribe(this, path);
+}
+
+// Refresh one top-level key of the values map, or all keys if empty
+void SettingsObjectPrivate::updateValues(const QString &key)
+{
+    if (!values)
+        return;
+
+    if (!key.isEmpty()) {
+        values->insert(key, object.value(key).toVariant());
+        return;
+    }
+
+    foreach (const QString &oldKey, values->keys()) {
+        if (!object.contains(oldKey))
+            values->insert(oldKey, QVariant());
     }
 
+    for (QJsonObject::const_iterator it = object.constBegin(); it != object.constEnd(); it++)
+        values->insert(it.key(), it.value().toVariant());
+}
+
+SettingsObjectPrivate::KeyEntry &SettingsObjectPrivate::keyEntry(const char *key)
+{
+    QHash<const char*,KeyEntry>::iterator it = keys.find(key);
+    if (it != keys.end())
+        return *it;
+
+    bool ok = false;
+    KeyEntry entry;
+    entry.path = SettingsFilePrivate::splitPath(QString::fromLatin1(key), ok);
+    entry.cached = false;
+    return *keys.insert(key, entry);
+}
+
+// Drop cached values for keys on the relative path key, or all if it's empty
+void SettingsObjectPrivate::invalidateKeys(const QStringList &key)
+{
+    for (QHash<const char*,KeyEntry>::iterator it = keys.begin(); it != keys.end(); it++) {
+        if (!it->cached)
+            continue;
+
+        int common = qMin(key.size(), it->path.size());
+        int i = 0;
+        while (i < common && key[i] == it->path[i])
+            i++;
+
+        if (i == common) {
+            it->cached = false;
+            it->value.clear();
+        }
+    }
+}
+
+// Reload data and drop cached keys after a write to key, without notifying
+void SettingsObjectPrivate::refresh(const QStringList &key)
+{
     object = file->d->read(file->d->jsonRoot, path).toObject();
-    emit q->modified(QStringList(key.mid(path.size())).join(QLatin1Char('.')), value);
-    emit q->dataChanged();
+    invalidateKeys(key.mid(path.size()));
+}
+
+// Emit SettingsObject::modified with a relative path; the file only
+// notifies objects with a matching path, and emits dataChanged afterwards.
+void SettingsObjectPrivate::modified(const QStringList &key, const QJsonValue &value)
+{
+    refresh(key);
+
+    QStringList relativeKey = key.mid(path.size());
+    updateValues(relativeKey.value(0));
+    emit q->modified(relativeKey.join(QLatin1Char('.')), value);
 }
 
 static QPointer<SettingsFile> defaultObjectFile;
+static QPointer<SettingsFile> stateObjectFile;
 
 SettingsFile *SettingsObject::defaultFile()
 {
@@ -462,6 +1230,21 @@ void SettingsObject::setDefaultFile(SettingsFile *file)
     defaultObjectFile = file;
 }
 
+SettingsFile *SettingsObject::stateFile()
+{
+    return stateObjectFile ? stateObjectFile : defaultObjectFile;
+}
+
+void SettingsObject::setStateFile(SettingsFile *file)
+{
+    stateObjectFile = file;
+}
+
+SettingsFile *SettingsObject::file() const
+{
+    return d->file;
+}
+
 QString SettingsObject::path() const
 {
     return d->path.join(QLatin1Char('.'));
@@ -472,9 +1255,12 @@ void SettingsObject::setPath(const QString &input)
     bool ok = false;
     QStringList newPath = SettingsFilePrivate::splitPath(input, ok);
     if (!ok) {
+        d->setSubscribed(false);
         d->invalid = true;
         d->path.clear();
         d->object = QJsonObject();
+        d->invalidateKeys();
+        d->updateValues();
 
         emit pathChanged();
         emit dataChanged();
@@ -484,10 +1270,14 @@ void SettingsObject::setPath(const QString &input)
     if (!d->invalid && d->path == newPath)
         return;
 
+    d->setSubscribed(false);
     d->path = newPath;
+    d->invalidateKeys();
     if (d->file) {
         d->invalid = false;
+        d->setSubscribed(true);
         d->object = d->file->d->read(d->file->d->jsonRoot, d->path).toObject();
+        d->updateValues();
         emit dataChanged();
     }
 
@@ -499,6 +1289,16 @@ QJsonObject SettingsObject::data() const
     return d->object;
 }
 
+QObject *SettingsObject::values()
+{
+    if (!d->values) {
+        d->values = new SettingsValueMap(this);
+        d->updateValues();
+    }
+
+    return d->values;
+}
+
 void SettingsObject::setData(const QJsonObject &input)
 {
     if (d->invalid || d->object == input)
@@ -550,4 +1350,47 @@ void SettingsObject::undefine()
     d->file->d->write(d->path, QJsonValue::Undefined);
 }
 
+bool SettingsObject::cachedValue(const char *key, QVariant &value) const
+{
+    const SettingsObjectPrivate::KeyEntry &entry = d->keyEntry(key);
+    if (!entry.cached)
+        return false;
+
+    value = entry.value;
+    return true;
+}
+
+void SettingsObject::setCachedValue(const char *key, const QVariant &value) const
+{
+    // Nothing is cached for an invalid object, because it's never notified of changes
+    if (d->invalid)
+        return;
+
+    SettingsObjectPrivate::KeyEntry &entry = d->keyEntry(key);
+    entry.value = value;
+    entry.cached = true;
+}
+
+QJsonValue SettingsObject::readKey(const char *key) const
+{
+    const SettingsObjectPrivate::KeyEntry &entry = d->keyEntry(key);
+    if (d->invalid || entry.path.isEmpty()) {
+        qDebug() << "Invalid settings read of path" << key;
+        return QJsonValue::Undefined;
+    }
+
+    return d->file->d->read(d->object, entry.path);
+}
+
+void SettingsObject::writeKey(const char *key, const QJsonValue &value)
+{
+    const SettingsObjectPrivate::KeyEntry &entry = d->keyEntry(key);
+    if (d->invalid || entry.path.isEmpty()) {
+        qDebug() << "Invalid settings write of path" << key;
+        return;
+    }
+
+    d->file->d->write(d->path + entry.path, value);
+}
+
 #include "Settings.moc"
@@ -39,6 +39,7 @@
 #include <QJsonArray>
 #include <QStringList>
 #include <QDateTime>
+#include <QVariant>
 
 class SettingsObject;
 class SettingsFilePrivate;
@@ -51,18 +52,40 @@ class SettingsObjectPrivate;
  *
  * Data is accessed via SettingsObject, either using the root property
  * or by creating a SettingsObject, optionally using a base path.
+ *
+ * Changes are not written to the file directly. Each write is recorded in an
+ * append-only journal next to the file (with a ".journal" suffix), which is
+ * flushed after syncInterval milliseconds without further writes. Once the
+ * journal grows large, it is compacted into the main file. The journal is
+ * replayed when the file is loaded. Serialization and disk writes happen on a
+ * separate thread, which is waited for when the SettingsFile is destroyed.
+ *
+ * With BinaryFormat, compaction writes a binary snapshot (with a ".snapshot"
+ * suffix) instead of the readable JSON file. With Qt before 5.12, the
+ * snapshot is memory-mapped and used without parsing when loading; later
+ * versions write it as CBOR. The JSON file is still written at
+ * shutdown, and if it is newer than the snapshot (e.g. edited by hand), it
+ * is loaded instead.
  */
 class SettingsFile : public QObject
 {
     Q_OBJECT
     Q_DISABLE_COPY(SettingsFile)
+    Q_ENUMS(Format)
 
     Q_PROPERTY(SettingsObject *root READ root CONSTANT)
     Q_PROPERTY(QString filePath READ filePath WRITE setFilePath NOTIFY filePathChanged)
     Q_PROPERTY(QString errorMessage READ errorMessage NOTIFY error)
     Q_PROPERTY(bool hasError READ hasError NOTIFY error)
+    Q_PROPERTY(Format format READ format WRITE setFormat NOTIFY formatChanged)
 
 public:
+    enum Format
+    {
+        JsonFormat,
+        BinaryFormat
+    };
+
     explicit SettingsFile(QObject *parent = 0);
     virtual ~SettingsFile();
 
@@ -72,11 +95,31 @@ public:
     QString errorMessage() const;
     bool hasError() const;
 
+    Format format() const;
+    void setFormat(Format format);
+
+    /* Write the current data as readable JSON to path */
+    bool exportJson(const QString &path);
+
+    /* Group writes into a single change. Writes are applied immediately and
+     * visible to reads through any SettingsObject, but are journaled and
+     * notified together when the outermost transaction is committed.
+     * Transactions may be nested. See also SettingsTransaction. */
+    void beginTransaction();
+    void commitTransaction();
+
+    /* Delay in milliseconds before pending changes are written to the journal,
+     * measured from the first unwritten change. Writes within this interval are
+     * coalesced into one append. */
+    int syncInterval() const;
+    void setSyncInterval(int msec);
+
     SettingsObject *root();
     const SettingsObject *root() const;
 
 signals:
     void filePathChanged();
+    void formatChanged();
     void error();
 
 private:
@@ -86,6 +129,28 @@ private:
     friend class SettingsObjectPrivate;
 };
 
+/* SettingsKey is a handle for a key that is read often, such as a contact's
+ * hostname or nickname. It can be declared as a constant from a literal:
+ *
+ *     static constexpr SettingsKey<QString> nicknameKey("nickname");
+ *     QString nickname = settings->read(nicknameKey);
+ *
+ * SettingsObject splits the key once, and keeps the decoded value until
+ * that path is modified. The key string must remain valid for the lifetime
+ * of any SettingsObject it is used with; string literals are ideal.
+ */
+template<typename T> class SettingsKey
+{
+public:
+    typedef T Type;
+
+    constexpr explicit SettingsKey(const char *key) : m_key(key) { }
+    constexpr const char *key() const { return m_key; }
+
+private:
+    const char *m_key;
+};
+
 /* SettingsObject reads and writes data within a SettingsFile
  *
  * A SettingsObject is associated with a SettingsFile and represents an object
@@ -108,6 +173,11 @@ private:
  * synchronized with changes. The modified signal is emitted for all changes
  * affecting keys within a path, including writes of object trees and from other
  * instances.
+ *
+ * The values property exposes the same top-level keys as data, but with a
+ * separate change notification for each key. QML bindings should prefer it,
+ * e.g. "uiSettings.values.language", so they are only re-evaluated when that
+ * key changes.
  */
 class SettingsObject : public QObject
 {
@@ -116,6 +186,7 @@ class SettingsObject : public QObject
 
     Q_PROPERTY(QString path READ path WRITE setPath NOTIFY pathChanged)
     Q_PROPERTY(QJsonObject data READ data WRITE setData NOTIFY dataChanged)
+    Q_PROPERTY(QObject *values READ values CONSTANT)
 
 public:
     explicit SettingsObject(QObject *parent = 0);
@@ -137,12 +208,24 @@ public:
     static SettingsFile *defaultFile();
     static void setDefaultFile(SettingsFile *file);
 
+    /* Specify a SettingsFile for volatile runtime state, such as the last time
+     * a contact was seen. Frequently changing values are kept out of the
+     * configuration file, and the state file is only written periodically.
+     * If no state file is set, defaultFile() is used.
+     */
+    static SettingsFile *stateFile();
+    static void setStateFile(SettingsFile *file);
+
+    SettingsFile *file() const;
+
     QString path() const;
     void setPath(const QString &path);
 
     QJsonObject data() const;
     void setData(const QJsonObject &data);
 
+    QObject *values();
+
     Q_INVOKABLE QJsonValue read(const QString &key, const QJsonValue &defaultValue = QJsonValue::Undefined) const;
     template<typename T> T read(const QString &key) const;
     Q_INVOKABLE void write(const QString &key, const QJsonValue &value);
@@ -171,6 +254,11 @@ public:
         unset(QString::fromLatin1(key));
     }
 
+    // SettingsKey overloads, which cache the decoded value
+    template<typename T> T read(const SettingsKey<T> &key, const typename SettingsKey<T>::Type &defaultValue = T()) const;
+    template<typename T> void write(const SettingsKey<T> &key, const typename SettingsKey<T>::Type &value);
+    template<typename T> void unset(const SettingsKey<T> &key);
+
     Q_INVOKABLE void undefine();
 
 signals:
@@ -181,60 +269,127 @@ signals:
 
 private:
     SettingsObjectPrivate *d;
+
+    bool cachedValue(const char *key, QVariant &value) const;
+    void setCachedValue(const char *key, const QVariant &value) const;
+    QJsonValue readKey(const char *key) const;
+    void writeKey(const char *key, const QJsonValue &value);
+};
+
+/* SettingsTransaction begins a transaction on a SettingsFile for the lifetime
+ * of the object, or until commit is called. For example:
+ *
+ *     SettingsObject settings(QStringLiteral("contactRequests.xyz"));
+ *     SettingsTransaction transaction(&settings);
+ *     settings.write("nickname", nickname);
+ *     settings.write("message", message);
+ *
+ * will emit notifications and schedule a sync only once.
+ */
+class SettingsTransaction
+{
+    Q_DISABLE_COPY(SettingsTransaction)
+
+public:
+    explicit SettingsTransaction(SettingsFile *file);
+    explicit SettingsTransaction(SettingsObject *object);
+    ~SettingsTransaction();
+
+    void commit();
+
+private:
+    SettingsFile *file;
 };
 
+/* Conversion of typed values to and from their JSON representation, used by
+ * the typed read and write functions of SettingsObject. */
+template<typename T> struct SettingsValue
+{
+    static T fromJson(const QJsonValue &value);
+    static QJsonValue toJson(const T &value) { return QJsonValue(value); }
+};
+
+template<typename T> inline T SettingsObject::read(const QString &key) const
+{
+    return SettingsValue<T>::fromJson(read(key));
+}
+
 template<typename T> inline void SettingsObject::write(const QString &key, const T &value)
 {
-    write(key, QJsonValue(value));
+    write(key, SettingsValue<T>::toJson(value));
 }
 
-template<> inline QString SettingsObject::read<QString>(const QString &key) const
+template<typename T> inline T SettingsObject::read(const SettingsKey<T> &key, const typename SettingsKey<T>::Type &defaultValue) const
 {
-    return read(key).toString();
+    QVariant value;
+    if (!cachedValue(key.key(), value)) {
+        QJsonValue json = readKey(key.key());
+        if (!json.isUndefined())
+            value = QVariant::fromValue(SettingsValue<T>::fromJson(json));
+        setCachedValue(key.key(), value);
+    }
+
+    return value.isValid() ? value.value<T>() : defaultValue;
 }
 
-template<> inline QJsonArray SettingsObject::read<QJsonArray>(const QString &key) const
+template<typename T> inline void SettingsObject::write(const SettingsKey<T> &key, const typename SettingsKey<T>::Type &value)
 {
-    return read(key).toArray();
+    writeKey(key.key(), SettingsValue<T>::toJson(value));
 }
 
-template<> inline QJsonObject SettingsObject::read<QJsonObject>(const QString &key) const
+template<typename T> inline void SettingsObject::unset(const SettingsKey<T> &key)
 {
-    return read(key).toObject();
+    writeKey(key.key(), QJsonValue());
 }
 
-template<> inline double SettingsObject::read<double>(const QString &key) const
+template<> inline QString SettingsValue<QString>::fromJson(const QJsonValue &value)
 {
-    return read(key).toDouble();
+    return value.toString();
 }
 
-template<> inline int SettingsObject::read<int>(const QString &key) const
+template<> inline QJsonArray SettingsValue<QJsonArray>::fromJson(const QJsonValue &value)
 {
-    return read(key).toInt();
+    return value.toArray();
 }
 
-template<> inline bool SettingsObject::read<bool>(const QString &key) const
+template<> inline QJsonObject SettingsValue<QJsonObject>::fromJson(const QJsonValue &value)
 {
-    return read(key).toBool();
+    return value.toObject();
 }
 
-template<> inline QDateTime SettingsObject::read<QDateTime>(const QString &key) const
+template<> inline double SettingsValue<double>::fromJson(const QJsonValue &value)
 {
-    QString value = read(key).toString();
-    if (value.isEmpty())
+    return value.toDouble();
+}
+
+template<> inline int SettingsValue<int>::fromJson(const QJsonValue &value)
+{
+    return value.toInt();
+}
+
+template<> inline bool SettingsValue<bool>::fromJson(const QJsonValue &value)
+{
+    return value.toBool();
+}
+
+template<> inline QDateTime SettingsValue<QDateTime>::fromJson(const QJsonValue &value)
+{
+    QString string = value.toString();
+    if (string.isEmpty())
         return QDateTime();
-    return QDateTime::fromString(value, Qt::ISODate).toLocalTime();
+    return QDateTime::fromString(string, Qt::ISODate).toLocalTime();
 }
 
-template<> inline void SettingsObject::write<QDateTime>(const QString &key, const QDateTime &value)
+template<> inline QJsonValue SettingsValue<QDateTime>::toJson(const QDateTime &value)
 {
-    write(key, QJsonValue(value.toUTC().toString(Qt::ISODate)));
+    return QJsonValue(value.toUTC().toString(Qt::ISODate));
 }
 
 // Explicitly store value encoded as base64. Decodes and casts implicitly to QByteArray for reads.
 class Base64Encode
 {
 public:
+    Base64Encode() { }
     explicit Base64Encode(const QByteArray &value) : d(value) { }
     operator QByteArray() { return d; }
     QByteArray encoded() const { return d.toBase64(); }
@@ -243,14 +398,16 @@ private:
     QByteArray d;
 };
 
-template<> inline Base64Encode SettingsObject::read<Base64Encode>(const QString &key) const
+Q_DECLARE_METATYPE(Base64Encode)
+
+template<> inline Base64Encode SettingsValue<Base64Encode>::fromJson(const QJsonValue &value)
 {
-    return Base64Encode(QByteArray::fromBase64(read(key).toString().toLatin1()));
+    return Base64Encode(QByteArray::fromBase64(value.toString().toLatin1()));
 }
 
-template<> inline void SettingsObject::write<Base64Encode>(const QString &key, const Base64Encode &value)
+template<> inline QJsonValue SettingsValue<Base64Encode>::toJson(const Base64Encode &value)
 {
-    write(key, QJsonValue(QString::fromLatin1(value.encoded())));
+    return QJsonValue(QString::fromLatin1(value.encoded()));
 }
 
 #endif
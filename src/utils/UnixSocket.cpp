@@ -0,0 +1,158 @@
+/* Ricochet - https://ricochet.im/
+ * Copyright (C) 2014, John Brooks <john.brooks@dereferenced.net>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *    * Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following disclaimer
+ *      in the documentation and/or other materials provided with the
+ *      distribution.
+ *
+ *    * Neither the names of the copyright owners nor the names of its
+ *      contributors may be used to endorse or promote products derived from
+ *      this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "UnixSocket.h"
+#include <QAbstractSocket>
+#include <QTcpServer>
+#include <QFile>
+
+#ifdef Q_OS_UNIX
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <string.h>
+
+static int createSocket(const QString &path, struct sockaddr_un *address, QString *errorMessage)
+{
+    QByteArray encodedPath = QFile::encodeName(path);
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    if (encodedPath.isEmpty() || encodedPath.size() >= int(sizeof(address->sun_path))) {
+        *errorMessage = QStringLiteral("Invalid unix socket path: %1").arg(path);
+        return -1;
+    }
+    memcpy(address->sun_path, encodedPath.constData(), encodedPath.size());
+
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        *errorMessage = QString::fromLocal8Bit(strerror(errno));
+        return -1;
+    }
+
+    ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+    return fd;
+}
+#endif
+
+bool isUnixSocketSupported()
+{
+#ifdef Q_OS_UNIX
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool connectUnixSocket(QAbstractSocket *socket, const QString &path, QString *errorMessage)
+{
+#ifdef Q_OS_UNIX
+    struct sockaddr_un address;
+    int fd = createSocket(path, &address, errorMessage);
+    if (fd < 0)
+        return false;
+
+    // Connecting to a local socket completes immediately, or fails
+    int re;
+    do {
+        re = ::connect(fd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address));
+    } while (re < 0 && errno == EINTR);
+
+    if (re < 0) {
+        *errorMessage = QStringLiteral("Cannot connect to %1: %2").arg(path, QString::fromLocal8Bit(strerror(errno)));
+        ::close(fd);
+        return false;
+    }
+
+    ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+    if (!socket->setSocketDescriptor(fd, QAbstractSocket::ConnectedState)) {
+        *errorMessage = socket->errorString();
+        ::close(fd);
+        return false;
+    }
+
+    return true;
+#else
+    Q_UNUSED(socket);
+    *errorMessage = QStringLiteral("Unix sockets are not supported on this platform (%1)").arg(path);
+    return false;
+#endif
+}
+
+bool listenUnixSocket(QTcpServer *server, const QString &path, QString *errorMessage)
+{
+#ifdef Q_OS_UNIX
+    struct sockaddr_un address;
+    int fd = createSocket(path, &address, errorMessage);
+    if (fd < 0)
+        return false;
+
+    // A socket file left behind by a previous instance would make bind fail
+    QFile::remove(path);
+
+    // Only this user (and Tor running as this user) may connect. The umask
+    // keeps the socket file closed to others from the moment it's created,
+    // before it's restricted further with chmod.
+    mode_t oldMask = ::umask(S_IRWXG | S_IRWXO);
+    int bound = ::bind(fd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address));
+    ::umask(oldMask);
+
+    if (bound < 0 || ::listen(fd, SOMAXCONN) < 0) {
+        *errorMessage = QStringLiteral("Cannot listen on %1: %2").arg(path, QString::fromLocal8Bit(strerror(errno)));
+        ::close(fd);
+        return false;
+    }
+
+    if (::chmod(address.sun_path, S_IRUSR | S_IWUSR) < 0) {
+        *errorMessage = QStringLiteral("Cannot set permissions of %1: %2").arg(path, QString::fromLocal8Bit(strerror(errno)));
+        ::close(fd);
+        QFile::remove(path);
+        return false;
+    }
+
+    ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+    if (!server->setSocketDescriptor(fd)) {
+        *errorMessage = server->errorString();
+        ::close(fd);
+        return false;
+    }
+
+    return true;
+#else
+    Q_UNUSED(server);
+    *errorMessage = QStringLiteral("Unix sockets are not supported on this platform (%1)").arg(path);
+    return false;
+#endif
+}
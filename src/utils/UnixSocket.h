@@ -0,0 +1,61 @@
+/* Ricochet - https://ricochet.im/
+ * Copyright (C) 2014, John Brooks <john.brooks@dereferenced.net>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *    * Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following disclaimer
+ *      in the documentation and/or other materials provided with the
+ *      distribution.
+ *
+ *    * Neither the names of the copyright owners nor the names of its
+ *      contributors may be used to endorse or promote products derived from
+ *      this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef UNIXSOCKET_H
+#define UNIXSOCKET_H
+
+#include <QString>
+
+class QAbstractSocket;
+class QTcpServer;
+
+/* Unix domain socket transport for QTcpSocket and QTcpServer
+ *
+ * Tor can use unix sockets for its control port, SOCKS port and onion
+ * service targets, which avoids TCP loopback, port allocation and exposing
+ * those ports to everything else on localhost. Qt's socket classes work
+ * with any stream socket descriptor (QLocalSocket itself is a QTcpSocket
+ * on unix), so these helpers create the descriptor and hand it over. The
+ * rest of the code keeps using QTcpSocket.
+ *
+ * A socket connected with connectUnixSocket is already in the connected
+ * state, and does not emit connected(); callers signal that themselves.
+ * Both functions return false and set 'errorMessage' on failure, including
+ * on platforms without unix sockets.
+ */
+bool isUnixSocketSupported();
+bool connectUnixSocket(QAbstractSocket *socket, const QString &path, QString *errorMessage);
+/* Listen on a new socket at 'path', replacing any stale socket file there */
+bool listenUnixSocket(QTcpServer *server, const QString &path, QString *errorMessage);
+
+#endif // UNIXSOCKET_H
@@ -32,6 +32,7 @@
 
 #include <QtTest>
 #include "utils/CryptoKey.h"
+#include "utils/OnionAddress.h"
 
 class TestCryptoKey : public QObject
 {
@@ -41,7 +42,10 @@ private slots:
     void load();
     void publicKeyDigest();
     void encodedPublicKey();
+    void encodedPrivateKey();
+    void generateNew();
     void torServiceID();
+    void onionAddress();
     void sign();
 };
 
@@ -150,6 +154,43 @@ void TestCryptoKey::encodedPublicKey()
     QVERIFY(!key4.loadFromData(pemEncoded, CryptoKey::PrivateKey));
 }
 
+void TestCryptoKey::encodedPrivateKey()
+{
+    CryptoKey key;
+    QVERIFY(key.loadFromData(alice, CryptoKey::PrivateKey));
+
+    QByteArray pemEncoded = key.encodedPrivateKey(CryptoKey::PEM);
+    QVERIFY(pemEncoded.contains("BEGIN RSA PRIVATE KEY"));
+
+    CryptoKey key2;
+    QVERIFY(key2.loadFromData(pemEncoded, CryptoKey::PrivateKey));
+    QVERIFY(key2.isPrivate());
+    QCOMPARE(key2.torServiceID(), QLatin1String(aliceTorID));
+
+    CryptoKey key3;
+    QVERIFY(key3.loadFromData(key.encodedPrivateKey(CryptoKey::DER), CryptoKey::PrivateKey, CryptoKey::DER));
+    QVERIFY(key3.isPrivate());
+    QCOMPARE(key3.torServiceID(), QLatin1String(aliceTorID));
+
+    // Public keys have no private encoding
+    CryptoKey key4;
+    QVERIFY(key4.loadFromData(bob, CryptoKey::PublicKey));
+    QVERIFY(key4.encodedPrivateKey().isEmpty());
+}
+
+void TestCryptoKey::generateNew()
+{
+    CryptoKey key;
+    QVERIFY(key.generateNew());
+    QVERIFY(key.isPrivate());
+    QCOMPARE(key.bits(), 1024);
+    QCOMPARE(key.torServiceID().size(), 16);
+
+    CryptoKey key2;
+    QVERIFY(key2.generateNew());
+    QVERIFY(key.torServiceID() != key2.torServiceID());
+}
+
 void TestCryptoKey::torServiceID()
 {
     CryptoKey key;
@@ -160,6 +201,37 @@ void TestCryptoKey::torServiceID()
     QCOMPARE(id, QLatin1String(bobTorID));
 }
 
+void TestCryptoKey::onionAddress()
+{
+    CryptoKey key;
+    QVERIFY(key.loadFromData(bob, CryptoKey::PublicKey));
+
+    OnionAddress address = OnionAddress::fromDigest(key.publicKeyDigest());
+    QVERIFY(address.isValid());
+    QCOMPARE(address.serviceID(), QLatin1String(bobTorID));
+    QCOMPARE(address.hostname(), QString::fromLatin1(bobTorID) + QLatin1String(".onion"));
+    QCOMPARE(address.contactID(), QLatin1String("ricochet:") + QString::fromLatin1(bobTorID));
+    QCOMPARE(address.digest(), QByteArray::fromHex(bobDigest).left(OnionAddress::DigestSize));
+
+    // All forms parse to the same address, in any case
+    QCOMPARE(OnionAddress::fromString(QString::fromLatin1(bobTorID)), address);
+    QCOMPARE(OnionAddress::fromString(QByteArray(bobTorID) + ".onion"), address);
+    QCOMPARE(OnionAddress::fromString(QStringLiteral("ricochet:WR4AZK67YNMTABCD")), address);
+    QCOMPARE(OnionAddress::fromString(QStringLiteral("torsion:wr4azk67ynmtabcd.ONION")), address);
+
+    QVERIFY(OnionAddress::fromString(QLatin1String(aliceTorID)) != address);
+
+    // Invalid forms
+    QVERIFY(!OnionAddress().isValid());
+    QVERIFY(!OnionAddress::fromString(QString()).isValid());
+    QVERIFY(!OnionAddress::fromString(QStringLiteral("wr4azk67ynmtabc")).isValid());
+    QVERIFY(!OnionAddress::fromString(QStringLiteral("wr4azk67ynmtabc1")).isValid());
+    QVERIFY(!OnionAddress::fromString(QStringLiteral("wr4azk67ynmtabcd.onion.onion")).isValid());
+    QVERIFY(!OnionAddress::fromString(QStringLiteral("example:wr4azk67ynmtabcd")).isValid());
+    QVERIFY(!OnionAddress::fromString(QString::fromUtf8("wr4azk67ynmtabc\xc3\xa9")).isValid());
+    QVERIFY(!OnionAddress::fromDigest(QByteArray(9, 0)).isValid());
+}
+
 void TestCryptoKey::sign()
 {
     CryptoKey key;
@@ -0,0 +1,81 @@
+/* Ricochet - https://ricochet.im/
+ * Copyright (C) 2014, John Brooks <john.brooks@dereferenced.net>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *    * Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following disclaimer
+ *      in the documentation and/or other materials provided with the
+ *      distribution.
+ *
+ *    * Neither the names of the copyright owners nor the names of its
+ *      contributors may be used to endorse or promote products derived from
+ *      this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <QtTest>
+#include <QTemporaryDir>
+#include <QSettings>
+#include "utils/LegacySettings.h"
+#include "utils/Settings.h"
+
+class TestLegacySettings : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void rejectedHostnames();
+};
+
+void TestLegacySettings::rejectedHostnames()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QString oldPath = dir.path() + QStringLiteral("/ricochet.ini");
+
+    {
+        QSettings old(oldPath, QSettings::IniFormat);
+        old.setValue(QStringLiteral("core/hostnameBlacklist"), QStringList()
+                     << QStringLiteral("expyuzz4wqqyqhjn.onion")
+                     << QStringLiteral("ricochet:qqqqqqqqqqqqqqqq")
+                     << QStringLiteral("invalid.onion"));
+    }
+
+    QDateTime before = QDateTime::currentDateTime().addSecs(-1);
+
+    SettingsFile settings;
+    QVERIFY(settings.setFilePath(dir.path() + QStringLiteral("/ricochet.json")));
+    QVERIFY(importLegacySettings(&settings, oldPath));
+
+    // A host is only rejected while its value is the time of rejection
+    QJsonObject rejected = settings.root()->read<QJsonObject>("identity.rejectedHostnames");
+    QCOMPARE(rejected.size(), 2);
+    foreach (const QString &serviceID, QStringList() << QStringLiteral("expyuzz4wqqyqhjn")
+                                                     << QStringLiteral("qqqqqqqqqqqqqqqq")) {
+        QJsonValue value = rejected.value(serviceID);
+        QVERIFY(value.isString());
+        QDateTime time = QDateTime::fromString(value.toString(), Qt::ISODate);
+        QVERIFY(time.isValid());
+        QVERIFY(time >= before);
+    }
+}
+
+QTEST_MAIN(TestLegacySettings)
+#include "tst_legacysettings.moc"
@@ -0,0 +1,10 @@
+include(../tests.pri)
+
+QT += qml
+
+SOURCES += tst_legacysettings.cpp \
+    $${SRC}/utils/LegacySettings.cpp \
+    $${SRC}/utils/Settings.cpp \
+    $${SRC}/utils/OnionAddress.cpp
+
+HEADERS += $${SRC}/utils/Settings.h
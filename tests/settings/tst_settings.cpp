@@ -0,0 +1,221 @@
+/* Ricochet - https://ricochet.im/
+ * Copyright (C) 2014, John Brooks <john.brooks@dereferenced.net>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *    * Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following disclaimer
+ *      in the documentation and/or other materials provided with the
+ *      distribution.
+ *
+ *    * Neither the names of the copyright owners nor the names of its
+ *      contributors may be used to endorse or promote products derived from
+ *      this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <QtTest>
+#include <QTemporaryDir>
+#include <QJsonDocument>
+#include "utils/Settings.h"
+
+class TestSettings : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+
+    void journalReplay();
+    void compaction();
+    void transaction();
+    void snapshot();
+
+private:
+    QTemporaryDir *dir;
+    QString path;
+
+    void writeFile(const QString &filePath, const QByteArray &data);
+    QJsonObject readJsonFile(const QString &filePath);
+};
+
+void TestSettings::init()
+{
+    dir = new QTemporaryDir;
+    QVERIFY(dir->isValid());
+    path = dir->path() + QStringLiteral("/settings.json");
+}
+
+void TestSettings::cleanup()
+{
+    delete dir;
+    dir = 0;
+}
+
+void TestSettings::writeFile(const QString &filePath, const QByteArray &data)
+{
+    QFile file(filePath);
+    QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    QCOMPARE(file.write(data), qint64(data.size()));
+}
+
+QJsonObject TestSettings::readJsonFile(const QString &filePath)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly))
+        return QJsonObject();
+    return QJsonDocument::fromJson(file.readAll()).object();
+}
+
+void TestSettings::journalReplay()
+{
+    // A journal left behind by a crash, ending in a record cut short; the
+    // record after it must not be applied either
+    writeFile(path, "{ \"a\": 1, \"b\": { \"c\": \"x\" }, \"d\": 3 }");
+    writeFile(path + QStringLiteral(".journal"),
+              "{\"path\":[\"a\"],\"value\":2}\n"
+              "{\"path\":[\"b\",\"c\"],\"value\":\"y\"}\n"
+              "{\"path\":[\"d\"]}\n"
+              "{\"path\":[\"e\"],\"val\n"
+              "{\"path\":[\"f\"],\"value\":true}\n");
+
+    {
+        SettingsFile settings;
+        QVERIFY(settings.setFilePath(path));
+
+        SettingsObject *root = settings.root();
+        QCOMPARE(root->read("a").toInt(), 2);
+        QCOMPARE(root->read("b.c").toString(), QStringLiteral("y"));
+        QVERIFY(root->read("d").isUndefined());
+        QVERIFY(root->read("e").isUndefined());
+        QVERIFY(root->read("f").isUndefined());
+
+        // Replayed changes are compacted into the file right away
+        QTRY_VERIFY(!QFile::exists(path + QStringLiteral(".journal")));
+    }
+
+    QJsonObject data = readJsonFile(path);
+    QCOMPARE(data.value(QStringLiteral("a")).toInt(), 2);
+    QCOMPARE(data.value(QStringLiteral("b")).toObject().value(QStringLiteral("c")).toString(), QStringLiteral("y"));
+    QVERIFY(!data.contains(QStringLiteral("d")));
+}
+
+void TestSettings::compaction()
+{
+    QString journalPath = path + QStringLiteral(".journal");
+    SettingsFile settings;
+    settings.setSyncInterval(0);
+    QVERIFY(settings.setFilePath(path));
+
+    // A small change is only appended to the journal
+    settings.root()->write(QStringLiteral("small"), QStringLiteral("value"));
+    QTRY_VERIFY(QFile::exists(journalPath));
+    QVERIFY(!readJsonFile(path).contains(QStringLiteral("small")));
+
+    // Once the journal outgrows the threshold (and the file), it's compacted
+    QString large(1024, QLatin1Char('x'));
+    for (int i = 0; i < 40; i++)
+        settings.root()->write(QStringLiteral("large.%1").arg(i), large);
+
+    QTRY_VERIFY_WITH_TIMEOUT(!QFile::exists(journalPath), 15000);
+    QJsonObject data = readJsonFile(path);
+    QCOMPARE(data.value(QStringLiteral("small")).toString(), QStringLiteral("value"));
+    QCOMPARE(data.value(QStringLiteral("large")).toObject().size(), 40);
+}
+
+void TestSettings::transaction()
+{
+    SettingsFile settings;
+    QVERIFY(settings.setFilePath(path));
+    SettingsObject group(&settings, QStringLiteral("group"));
+    QSignalSpy dataChanged(&group, SIGNAL(dataChanged()));
+    QSignalSpy modified(&group, SIGNAL(modified(QString,QJsonValue)));
+
+    {
+        SettingsTransaction transaction(&settings);
+        group.write(QStringLiteral("one"), 1);
+        group.write(QStringLiteral("two"), 2);
+        group.write(QStringLiteral("one"), 3);
+
+        {
+            // Nested transactions are committed with the outermost
+            SettingsTransaction nested(&group);
+            group.write(QStringLiteral("three"), 3);
+        }
+
+        // Writes are visible to reads before anything is notified
+        QCOMPARE(group.read("one").toInt(), 3);
+        QCOMPARE(group.read("three").toInt(), 3);
+        QCOMPARE(dataChanged.count(), 0);
+        QCOMPARE(modified.count(), 0);
+    }
+
+    QCOMPARE(dataChanged.count(), 1);
+    QCOMPARE(modified.count(), 3);
+    QCOMPARE(group.read("one").toInt(), 3);
+    QCOMPARE(group.read("two").toInt(), 2);
+
+    // A transaction that ends where it began notifies nothing
+    {
+        SettingsTransaction transaction(&settings);
+        group.write(QStringLiteral("two"), 5);
+        group.write(QStringLiteral("two"), 2);
+    }
+
+    QCOMPARE(dataChanged.count(), 1);
+    QCOMPARE(modified.count(), 3);
+}
+
+void TestSettings::snapshot()
+{
+    QString snapshotPath = path + QStringLiteral(".snapshot");
+    QJsonArray array;
+    array.append(1);
+    array.append(QStringLiteral("two"));
+
+    {
+        SettingsFile settings;
+        settings.setFormat(SettingsFile::BinaryFormat);
+        QVERIFY(settings.setFilePath(path));
+        settings.root()->write(QStringLiteral("string"), QStringLiteral("value"));
+        settings.root()->write(QStringLiteral("nested.number"), 42);
+        settings.root()->write(QStringLiteral("nested.bool"), true);
+        settings.root()->write(QStringLiteral("array"), array);
+    }
+
+    // The readable file is still written at shutdown
+    QVERIFY(QFile::exists(snapshotPath));
+    QCOMPARE(readJsonFile(path).value(QStringLiteral("string")).toString(), QStringLiteral("value"));
+
+    // Without the readable file, everything must come from the snapshot
+    QVERIFY(QFile::remove(path));
+
+    SettingsFile settings;
+    settings.setFormat(SettingsFile::BinaryFormat);
+    QVERIFY(settings.setFilePath(path));
+    SettingsObject *root = settings.root();
+    QCOMPARE(root->read("string").toString(), QStringLiteral("value"));
+    QCOMPARE(root->read("nested.number").toInt(), 42);
+    QCOMPARE(root->read("nested.bool").toBool(), true);
+    QCOMPARE(root->read("array").toArray(), array);
+}
+
+QTEST_MAIN(TestSettings)
+#include "tst_settings.moc"
@@ -0,0 +1,8 @@
+include(../tests.pri)
+
+QT += qml
+
+SOURCES += tst_settings.cpp \
+    $${SRC}/utils/Settings.cpp
+
+HEADERS += $${SRC}/utils/Settings.h
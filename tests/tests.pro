@@ -1,2 +1,2 @@
 TEMPLATE = subdirs
-SUBDIRS += cryptokey
+SUBDIRS += cryptokey settings legacysettings torcontrol
@@ -0,0 +1,189 @@
+/* Ricochet - https://ricochet.im/
+ * Copyright (C) 2014, John Brooks <john.brooks@dereferenced.net>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *    * Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *    * Redistributions in binary form must reproduce the above
+ *      copyright notice, this list of conditions and the following disclaimer
+ *      in the documentation and/or other materials provided with the
+ *      distribution.
+ *
+ *    * Neither the names of the copyright owners nor the names of its
+ *      contributors may be used to endorse or promote products derived from
+ *      this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <QtTest>
+#include <QTemporaryDir>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include "tor/TorControl.h"
+#include "tor/HiddenService.h"
+#include "utils/CryptoKey.h"
+#include "utils/Settings.h"
+
+using namespace Tor;
+
+/* Minimal control port, which records each command and replies to it as a
+ * Tor started with an old torrc would */
+class FakeControlPort : public QTcpServer
+{
+    Q_OBJECT
+
+public:
+    QList<QByteArray> commands;
+    QByteArray addOnionReply;
+    QString torrcPath;
+    QList<QByteArray> configText;
+
+    FakeControlPort()
+        : socket(0)
+    {
+        connect(this, &QTcpServer::newConnection, this, &FakeControlPort::accept);
+    }
+
+private slots:
+    void accept()
+    {
+        socket = nextPendingConnection();
+        connect(socket, &QTcpSocket::readyRead, this, &FakeControlPort::process);
+    }
+
+    void process()
+    {
+        while (socket->canReadLine()) {
+            QByteArray line = socket->readLine().trimmed();
+            commands.append(line);
+            socket->write(reply(line));
+        }
+    }
+
+private:
+    QTcpSocket *socket;
+
+    QByteArray reply(const QByteArray &line)
+    {
+        if (line.startsWith("PROTOCOLINFO"))
+            return "250-PROTOCOLINFO 1\r\n250-AUTH METHODS=NULL\r\n250-VERSION Tor=\"0.2.7.6\"\r\n250 OK\r\n";
+        if (line.startsWith("ADD_ONION"))
+            return addOnionReply;
+        if (line.startsWith("GETINFO config-text")) {
+            QByteArray re("250+config-text=\r\n");
+            foreach (const QByteArray &configLine, configText)
+                re += configLine + "\r\n";
+            re += ".\r\n250-config-file=" + QFile::encodeName(torrcPath) + "\r\n250 OK\r\n";
+            return re;
+        }
+        return "250 OK\r\n";
+    }
+};
+
+class TestTorControl : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void cleanup();
+
+    void serviceInTorrc();
+
+private:
+    QTemporaryDir *dir;
+    SettingsFile *settings;
+
+    QByteArray readFile(const QString &filePath);
+};
+
+void TestTorControl::init()
+{
+    dir = new QTemporaryDir;
+    QVERIFY(dir->isValid());
+    settings = new SettingsFile;
+    QVERIFY(settings->setFilePath(dir->path() + QStringLiteral("/ricochet.json")));
+    SettingsObject::setDefaultFile(settings);
+}
+
+void TestTorControl::cleanup()
+{
+    SettingsObject::setDefaultFile(0);
+    delete settings;
+    settings = 0;
+    delete dir;
+    dir = 0;
+}
+
+QByteArray TestTorControl::readFile(const QString &filePath)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly))
+        return QByteArray();
+    return file.readAll();
+}
+
+void TestTorControl::serviceInTorrc()
+{
+    // A service whose key is also configured in torrc, as saved by old versions
+    QString dataPath = dir->path() + QStringLiteral("/hidden_service");
+    QVERIFY(QDir().mkpath(dataPath));
+    CryptoKey key;
+    QVERIFY(key.generateNew());
+    QFile keyFile(dataPath + QStringLiteral("/private_key"));
+    QVERIFY(keyFile.open(QIODevice::WriteOnly));
+    keyFile.write(key.encodedPrivateKey(CryptoKey::PEM));
+    keyFile.close();
+
+    HiddenService service(dataPath);
+    service.addTarget(9878, QHostAddress::LocalHost, 12345);
+    QCOMPARE(service.status(), HiddenService::Offline);
+
+    FakeControlPort tor;
+    QVERIFY(tor.listen(QHostAddress::LocalHost));
+    tor.addOnionReply = "550 Onion address collision\r\n";
+    tor.torrcPath = dir->path() + QStringLiteral("/torrc");
+    tor.configText << QByteArray("SocksPort 9150")
+                   << QByteArray("HiddenServiceDir ") + QFile::encodeName(dataPath)
+                   << QByteArray("HiddenServicePort 9878 127.0.0.1:1234");
+    QFile torrc(tor.torrcPath);
+    QVERIFY(torrc.open(QIODevice::WriteOnly));
+    foreach (const QByteArray &line, tor.configText)
+        torrc.write(line + "\n");
+    torrc.close();
+
+    TorControl control;
+    control.addHiddenService(&service);
+    control.connect(QHostAddress::LocalHost, tor.serverPort());
+
+    // The service is published with its current targets through HiddenServiceDir
+    QTRY_COMPARE(service.status(), HiddenService::Online);
+    QByteArray setConf;
+    foreach (const QByteArray &command, tor.commands) {
+        if (command.startsWith("SETCONF HiddenServiceDir"))
+            setConf = command;
+    }
+    QVERIFY(setConf.contains(QFile::encodeName(QDir(dataPath).absolutePath())));
+    QVERIFY(setConf.contains("HiddenServicePort=\"9878 127.0.0.1:12345\""));
+
+    // ..and removed from torrc, so it's published with ADD_ONION next time
+    QTRY_COMPARE(readFile(tor.torrcPath), QByteArray("SocksPort 9150\n"));
+}
+
+QTEST_MAIN(TestTorControl)
+#include "tst_torcontrol.moc"
@@ -0,0 +1,58 @@
+include(../tests.pri)
+
+QT += network qml
+
+SOURCES += tst_torcontrol.cpp \
+    $${SRC}/tor/TorControl.cpp \
+    $${SRC}/tor/TorControlSocket.cpp \
+    $${SRC}/tor/TorControlCommand.cpp \
+    $${SRC}/tor/ProtocolInfoCommand.cpp \
+    $${SRC}/tor/AuthenticateCommand.cpp \
+    $${SRC}/tor/SetConfCommand.cpp \
+    $${SRC}/tor/GetConfCommand.cpp \
+    $${SRC}/tor/AddOnionCommand.cpp \
+    $${SRC}/tor/HiddenService.cpp \
+    $${SRC}/tor/TorEvents.cpp \
+    $${SRC}/tor/ConnectionTimings.cpp \
+    $${SRC}/tor/DescriptorProbe.cpp \
+    $${SRC}/utils/CryptoKey.cpp \
+    $${SRC}/utils/OnionAddress.cpp \
+    $${SRC}/utils/SecureRNG.cpp \
+    $${SRC}/utils/StringUtil.cpp \
+    $${SRC}/utils/Settings.cpp \
+    $${SRC}/utils/PendingOperation.cpp \
+    $${SRC}/utils/UnixSocket.cpp
+
+HEADERS += $${SRC}/tor/TorControl.h \
+    $${SRC}/tor/TorControlSocket.h \
+    $${SRC}/tor/TorControlCommand.h \
+    $${SRC}/tor/ProtocolInfoCommand.h \
+    $${SRC}/tor/AuthenticateCommand.h \
+    $${SRC}/tor/SetConfCommand.h \
+    $${SRC}/tor/GetConfCommand.h \
+    $${SRC}/tor/AddOnionCommand.h \
+    $${SRC}/tor/HiddenService.h \
+    $${SRC}/tor/TorEvents.h \
+    $${SRC}/tor/ConnectionTimings.h \
+    $${SRC}/tor/DescriptorProbe.h \
+    $${SRC}/utils/Settings.h \
+    $${SRC}/utils/PendingOperation.h
+
+unix:!macx {
+    !isEmpty(OPENSSLDIR) {
+        INCLUDEPATH += $${OPENSSLDIR}/include
+        LIBS += -L$${OPENSSLDIR}/lib -lcrypto
+    } else {
+        CONFIG += link_pkgconfig
+        PKGCONFIG += libcrypto
+    }
+}
+win32 {
+    isEmpty(OPENSSLDIR):error(You must pass OPENSSLDIR=path/to/openssl to qmake on this platform)
+    INCLUDEPATH += $${OPENSSLDIR}/include
+    LIBS += -L$${OPENSSLDIR}/lib -llibeay32
+
+    # required by openssl
+    LIBS += -lUser32 -lGdi32 -ladvapi32
+}
+macx:LIBS += -lcrypto